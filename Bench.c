@@ -0,0 +1,1014 @@
+////////////////////////////////////////////////////////////////////////////////
+// -------------------------------------------------------------------------- //
+//                                                                            //
+//                          Copyright (C) 2012-2013                           //
+//                            github.com/dkrutsko                             //
+//                            github.com/Harrold                              //
+//                            github.com/AbsMechanik                          //
+//                                                                            //
+//                        See LICENSE.md for copyright                        //
+//                                                                            //
+// -------------------------------------------------------------------------- //
+////////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------//
+// Prefaces                                                                   //
+//----------------------------------------------------------------------------//
+
+#define _GNU_SOURCE
+#include "NDP.h"
+
+#include <math.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <endian.h>
+
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+
+
+
+//----------------------------------------------------------------------------//
+// Locals                                                                     //
+//----------------------------------------------------------------------------//
+
+// Table sizes covered by the microbenchmarks
+static const unsigned int sSizes[] = { 32, 1000, 100000, 1000000 };
+
+// Beacons applied to measure refreshes
+#define REFRESH_COUNT 2000000
+
+// Runs used to measure the discovery latency
+#define DISCOVERY_RUNS 20
+
+// Stress rates tried to find the sustained rate
+static const int sRates[] = { 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 0 };
+
+// Share of beacons which must arrive to sustain a rate
+#define SUSTAINED_SHARE 0.99
+
+// Beacons sent to measure the wire to table latency
+#define WIRE_BEACONS 2000
+
+// Largest number of commands in a churn scenario
+#define SCENARIO_LEN 256
+
+// Beacons sent by the emulator at once
+#define EMULATE_BATCH 256
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the number of bytes allocated on the heap. </summary>
+
+static unsigned long long HeapUsed (void)
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prints a single result as a line of JSON. </summary>
+
+static void Result (const char* suite, const char* bench, const char* key,
+	unsigned int parameter, const char* unit, double value)
+{
+	printf ("{\"suite\":\"%s\",\"bench\":\"%s\",\"%s\":%u,\"%s\":%.2f}\n",
+		suite, bench, key, parameter, unit, value);
+	fflush (stdout);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Micro                                                                      //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Measures the table operations at a given number of neighbors. </summary>
+/// <remarks> Beacons are injected on a simulated clock so the table
+///           is exercised without sockets or threads. </remarks>
+
+static void MicroTable (unsigned int count)
+{
+	unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+	unsigned long long start, now = 0;
+	unsigned int i;
+
+	// Create random neighbor addresses
+	NDP_Addr* addrs = (NDP_Addr*) malloc (count * sizeof (NDP_Addr));
+	for (i = 0; i < count; ++i)
+	{
+		unsigned long long r = NDP_Random (&seed);
+		memcpy (addrs[i].Data, &r, NDP_ADDR_LEN);
+	}
+
+	unsigned long long heap = HeapUsed();
+
+	NDP_State state;
+	NDP_Init (&state);
+	NDP_CreateOffline (&state, now);
+
+	// Insert every neighbor
+	start = NDP_TimeNS();
+	for (i = 0; i < count; ++i)
+		NDP_Inject (&state, &addrs[i], now);
+
+	Result ("micro", "insert", "neighbors", count, "ns_per_beacon",
+		(double) (NDP_TimeNS() - start) / count);
+
+	Result ("micro", "memory", "neighbors", count, "bytes_per_neighbor",
+		(double) (HeapUsed() - heap) / count);
+
+	// Refresh neighbors in random order
+	start = NDP_TimeNS();
+	for (i = 0; i < REFRESH_COUNT; ++i)
+		NDP_Inject (&state, &addrs[NDP_Random (&seed) % count], now);
+
+	Result ("micro", "refresh", "neighbors", count, "ns_per_beacon",
+		(double) (NDP_TimeNS() - start) / REFRESH_COUNT);
+
+	// Publish the table without aging it
+	now += state.PublishInterval;
+	start = NDP_TimeNS();
+	NDP_Advance (&state, now);
+
+	Result ("micro", "publish", "neighbors", count, "ns_per_neighbor",
+		(double) (NDP_TimeNS() - start) / count);
+
+	// Age the table without expiring anyone
+	now += state.AgeInterval - state.PublishInterval;
+	start = NDP_TimeNS();
+	NDP_Advance (&state, now);
+
+	Result ("micro", "age_tick", "neighbors", count, "ns",
+		(double) (NDP_TimeNS() - start));
+
+	// Expire every neighbor at once
+	now += state.Timeout + state.AgeInterval;
+	start = NDP_TimeNS();
+	NDP_Advance (&state, now);
+
+	Result ("micro", "expire", "neighbors", count, "ns_per_neighbor",
+		(double) (NDP_TimeNS() - start) / count);
+
+	NDP_Destroy (&state);
+	free (addrs);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Sender                                                                     //
+//----------------------------------------------------------------------------//
+
+// Addresses of emulated neighbors start with this prefix
+static const unsigned char sPrefix[2] = { 0x02, 0x4E };
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the address of an emulated neighbor. </summary>
+
+static void VirtualAddr (unsigned int index, NDP_Addr* addr)
+{
+	addr->Data[0] = sPrefix[0];
+	addr->Data[1] = sPrefix[1];
+	addr->Data[2] = (unsigned char) (index >> 24);
+	addr->Data[3] = (unsigned char) (index >> 16);
+	addr->Data[4] = (unsigned char) (index >>  8);
+	addr->Data[5] = (unsigned char) (index      );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Opens a socket which broadcasts on the interface. </summary>
+/// <remarks> The socket is bound to no protocol so it never receives. </remarks>
+/// <returns> The socket or negative one for failure. </returns>
+
+static int OpenSender (const char* interface, struct sockaddr_ll* to)
+{
+	memset (to, 0, sizeof (struct sockaddr_ll));
+	to->sll_family  = AF_PACKET;
+	to->sll_ifindex = (int) if_nametoindex (interface);
+	to->sll_halen   = NDP_ADDR_LEN;
+	memset (to->sll_addr, 255, NDP_ADDR_LEN);
+
+	if (to->sll_ifindex == 0)
+		return -1;
+
+	return socket (AF_PACKET, SOCK_RAW, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Broadcasts one beacon on behalf of each of the sources. </summary>
+/// <remarks> Beacons are written in the wire format of the protocol, with
+///           the given sequence numbers and the current time. </remarks>
+/// <returns> Number of beacons sent or negative one for failure. </returns>
+
+static int SendAs (int socket, const struct sockaddr_ll* to,
+	const NDP_Addr* sources, const unsigned int* sequences, int count)
+{
+	unsigned char frames[EMULATE_BATCH][NDP_BEACON_MAX_LEN];
+	struct iovec vectors[EMULATE_BATCH];
+	struct mmsghdr headers[EMULATE_BATCH];
+	uint64_t now = htobe64 (NDP_TimeNS());
+	unsigned short type = htons (NDP_BEACON_TYPE);
+	int i, n, sent = 0;
+
+	memset (headers, 0, sizeof (headers));
+
+	while (sent < count)
+	{
+		n = count - sent < EMULATE_BATCH ? count - sent : EMULATE_BATCH;
+
+		for (i = 0; i < n; ++i)
+		{
+			unsigned char* frame = frames[i];
+			uint32_t sequence = htonl (sequences[sent + i]);
+
+			// Broadcast header
+			memset (frame, 255, NDP_ADDR_LEN);
+			memcpy (frame + NDP_ADDR_LEN, &sources[sent + i], NDP_ADDR_LEN);
+			memcpy (frame + NDP_ADDR_LEN * 2, &type, sizeof (type));
+
+			// Version, sequence and send time in network byte order
+			unsigned char* field = frame + NDP_BEACON_HEADER_LEN;
+			*field++ = NDP_BEACON_VERSION;
+
+			*field++ = NDP_FIELD_SEQUENCE;
+			*field++ = sizeof (sequence);
+			memcpy (field, &sequence, sizeof (sequence));
+			field += sizeof (sequence);
+
+			*field++ = NDP_FIELD_TIMESTAMP;
+			*field++ = sizeof (now);
+			memcpy (field, &now, sizeof (now));
+			field += sizeof (now);
+
+			vectors[i].iov_base = frame;
+			vectors[i].iov_len  = field - frame;
+
+			headers[i].msg_hdr.msg_name    = (void*) to;
+			headers[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_ll);
+			headers[i].msg_hdr.msg_iov     = &vectors[i];
+			headers[i].msg_hdr.msg_iovlen  = 1;
+		}
+
+		n = sendmmsg (socket, headers, n, 0);
+		if (n <= 0)
+			return sent > 0 ? sent : -1;
+
+		sent += n;
+	}
+
+	return sent;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// End to End                                                                 //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the neighbor awaited by the discovery runs. </summary>
+
+typedef struct
+{
+	NDP_Addr Addr;					// Address of the sender
+	volatile unsigned long long Found;	// Time it was discovered (ns)
+
+} Discovery;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Records when the awaited neighbor comes up. </summary>
+
+static void OnEvent (const NDP_Event* event, void* data)
+{
+	Discovery* discovery = (Discovery*) data;
+	if (event->Type == NDP_NEIGHBOR_UP && discovery->Found == 0 &&
+		memcmp (&event->Addr, &discovery->Addr, sizeof (NDP_Addr)) == 0)
+		discovery->Found = NDP_TimeNS();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Compares two durations for sorting. </summary>
+
+static int CompareTimes (const void* a, const void* b)
+{
+	unsigned long long x = *(const unsigned long long*) a;
+	unsigned long long y = *(const unsigned long long*) b;
+	return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Measures the time from starting a sender until the
+///           receiver on the other end of the link has found it. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int EndDiscovery (const char* sender, const char* receiver)
+{
+	unsigned long long times[DISCOVERY_RUNS];
+	Discovery discovery;
+	NDP_State a, b;
+	int i, found = 0;
+
+	for (i = 0; i < DISCOVERY_RUNS; ++i)
+	{
+		NDP_Init (&a); snprintf (a.Interface, NDP_IFNAME_LEN, "%s", sender  );
+		NDP_Init (&b); snprintf (b.Interface, NDP_IFNAME_LEN, "%s", receiver);
+
+		b.Silent = 1;
+		b.EventCallback = OnEvent;
+		b.EventData = &discovery;
+
+		NDP_Create (&a);
+		NDP_Create (&b);
+
+		if (a.Error != NDP_ERROR_NONE || b.Error != NDP_ERROR_NONE)
+		{
+			fprintf (stderr, "%s\n", NDP_ErrorString (a.Error ? &a : &b));
+			NDP_Destroy (&a); NDP_Destroy (&b);
+			return -1;
+		}
+
+		discovery.Addr  = a.Addr;
+		discovery.Found = 0;
+		NDP_Start (&b);
+
+		// The first beacon goes out right away
+		unsigned long long start = NDP_TimeNS();
+		NDP_Start (&a);
+
+		while (discovery.Found == 0 && NDP_TimeNS() - start < 1000000000ULL)
+			usleep (10);
+
+		if (discovery.Found != 0)
+			times[found++] = discovery.Found - start;
+
+		NDP_Destroy (&a);
+		NDP_Destroy (&b);
+	}
+
+	if (found == 0)
+		return -1;
+
+	qsort (times, found, sizeof (times[0]), CompareTimes);
+	Result ("e2e", "discovery_p50", "runs", found, "us", times[found / 2] * 1e-3);
+	Result ("e2e", "discovery_max", "runs", found, "us", times[found - 1] * 1e-3);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Floods the receiver at increasing rates and reports the
+///           highest rate at which nearly every beacon arrives. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int EndThroughput (const char* sender, const char* receiver)
+{
+	NDP_Stats before, after;
+	NDP_State a, b;
+	double sustained = 0;
+	unsigned int i;
+
+	NDP_Init (&a); snprintf (a.Interface, NDP_IFNAME_LEN, "%s", sender  );
+	NDP_Init (&b); snprintf (b.Interface, NDP_IFNAME_LEN, "%s", receiver);
+
+	// Keep the table of spoofed neighbors bounded
+	b.Backend = NDP_RECV_RING;
+	b.Timeout = 1000;
+
+	NDP_Create (&a);
+	NDP_Create (&b);
+
+	if (a.Error != NDP_ERROR_NONE || b.Error != NDP_ERROR_NONE)
+	{
+		fprintf (stderr, "%s\n", NDP_ErrorString (a.Error ? &a : &b));
+		NDP_Destroy (&a); NDP_Destroy (&b);
+		return -1;
+	}
+
+	NDP_Start (&a);
+	NDP_Start (&b);
+
+	for (i = 0; i < sizeof (sRates) / sizeof (sRates[0]); ++i)
+	{
+		a.StressRate = sRates[i];
+		NDP_GetStats (&b, &before);
+		unsigned long long sent = NDP_StressSent (&a);
+
+		NDP_SetStress (&a, 1);
+		sleep (1);
+		NDP_SetStress (&a, 0);
+
+		// Let the receiver drain its queue
+		usleep (200000);
+		NDP_GetStats (&b, &after);
+
+		sent = NDP_StressSent (&a) - sent;
+		unsigned long long accepted =
+			after.BeaconsAccepted - before.BeaconsAccepted;
+
+		Result ("e2e", "offered", "rate", sRates[i], "beacons_per_s", (double) sent);
+		Result ("e2e", "accepted", "rate", sRates[i], "beacons_per_s", (double) accepted);
+
+		if (sent > 0 && accepted >= sent * SUSTAINED_SHARE && accepted > sustained)
+			sustained = accepted;
+	}
+
+	Result ("e2e", "sustained", "rate", 0, "beacons_per_s", sustained);
+
+	NDP_Destroy (&a);
+	NDP_Destroy (&b);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Measures the time from the kernel receiving beacons until
+///           they reach the table, with or without the low latency
+///           profile on the receiver. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int EndWireLatency (const char* sender, const char* receiver, int low)
+{
+	struct sockaddr_ll to;
+	NDP_Stats stats;
+	NDP_State b;
+	NDP_Addr source;
+	int i;
+
+	NDP_Init (&b); snprintf (b.Interface, NDP_IFNAME_LEN, "%s", receiver);
+
+	b.Silent = 1;
+	b.Timestamps = 1;
+
+	// Keep the receiver off the CPUs likely used by the sender
+	if (low != 0)
+	{
+		b.LowLatency = 1;
+		b.RecvCPU = (int) sysconf (_SC_NPROCESSORS_ONLN) - 1;
+	}
+
+	int socket = OpenSender (sender, &to);
+	NDP_Create (&b);
+	NDP_Start  (&b);
+
+	if (socket < 0 || b.Error != NDP_ERROR_NONE)
+	{
+		fprintf (stderr, "%s\n", socket < 0 ?
+			"Failed to open the sender" : NDP_ErrorString (&b));
+		if (socket >= 0) close (socket);
+		NDP_Destroy (&b);
+		return -1;
+	}
+
+	// Send spaced out beacons so none of them queue up
+	VirtualAddr (0, &source);
+	for (i = 0; i < WIRE_BEACONS; ++i)
+	{
+		unsigned int sequence = (unsigned int) i;
+		SendAs (socket, &to, &source, &sequence, 1);
+		usleep (1000);
+	}
+
+	// Let the receiver drain its queue
+	usleep (100000);
+	NDP_GetStats (&b, &stats);
+
+	Result ("e2e", "wire_p50", "low_latency", low, "ns", (double) NDP_Percentile (stats.WireLatency, 0.50));
+	Result ("e2e", "wire_p99", "low_latency", low, "ns", (double) NDP_Percentile (stats.WireLatency, 0.99));
+
+	close (socket);
+	NDP_Destroy (&b);
+	return 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Churn                                                                      //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Commands of a churn scenario. </summary>
+
+enum
+{
+	COMMAND_TIMEOUT,		// Neighbor timeout of the receiver (ms)
+	COMMAND_INTERVAL,		// Beacon intervals of later arrivals (ms)
+	COMMAND_ARRIVE,			// Neighbors which arrive at once
+	COMMAND_DEPART,			// Random neighbors which depart at once
+	COMMAND_CHURN,			// Arrivals and departures per second
+	COMMAND_END,			// End of the scenario
+};
+
+static const char* sCommands[] =
+{
+	"timeout", "interval", "arrive", "depart", "churn", "end", NULL
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single timed command of a scenario. </summary>
+
+typedef struct
+{
+	double Time;			// Seconds from the start
+	int Command;			// One of the commands
+	double First;			// First argument
+	double Second;			// Second argument
+
+} Command;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single emulated neighbor. </summary>
+/// <remarks> Neighbors live once, a later arrival is a new neighbor.
+///           Detection times are written by the receiving thread. </remarks>
+
+typedef struct
+{
+	unsigned long long Next;		// Time of the next beacon (ns)
+	unsigned long long Interval;	// Time between beacons (ns)
+	unsigned long long Arrived;		// Time of the first beacon (ns)
+	unsigned long long Last;		// Time of the latest beacon (ns)
+	volatile unsigned long long Departed;	// Time it went silent (ns)
+	volatile unsigned long long Up;		// Time it was detected (ns)
+	volatile unsigned long long Down;	// Time it was expired (ns)
+	unsigned int Sequence;			// Next sequence number
+
+} Virtual;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the state of the emulator. </summary>
+
+typedef struct
+{
+	Virtual* Neighbors;			// Every neighbor ever created
+	unsigned int Count;			// Number of neighbors created
+	unsigned int Size;			// Allocated neighbors
+
+	unsigned int* Present;		// Neighbors currently beaconing
+	unsigned int PresentCount;	// Number of present neighbors
+
+	unsigned int* Heap;			// Present neighbors by next beacon
+	unsigned int HeapCount;		// Entries in the heap
+
+	unsigned long long MinInterval;	// Interval range of arrivals (ns)
+	unsigned long long MaxInterval;
+
+	volatile unsigned long long FalseDepartures;	// Expired while present
+	unsigned long long Seed;	// Random state
+
+} Emulator;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns a uniform random number in [0, 1). </summary>
+
+static double NextUniform (unsigned long long* seed)
+{
+	return (NDP_Random (seed) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Loads a scenario with one timed command per line. </summary>
+/// <remarks> Empty lines and anything after a # are ignored, times
+///           must not go backwards. </remarks>
+/// <returns> Number of commands or negative one for failure. </returns>
+
+static int LoadScenario (const char* path, Command* commands)
+{
+	char line[256], name[32];
+	int count = 0, number = 0, i;
+
+	FILE* file = fopen (path, "r");
+	if (file == NULL)
+		{ perror (path); return -1; }
+
+	while (fgets (line, sizeof (line), file) != NULL)
+	{
+		++number;
+
+		char* comment = strchr (line, '#');
+		if (comment != NULL)
+			*comment = 0;
+
+		Command* command = &commands[count];
+		command->First = command->Second = 0;
+
+		int fields = sscanf (line, "%lf %31s %lf %lf", &command->Time,
+			name, &command->First, &command->Second);
+
+		if (fields <= 0)
+			continue;
+
+		for (i = 0; sCommands[i] != NULL && strcmp (sCommands[i], name) != 0; ++i);
+
+		if (fields < 2 || sCommands[i] == NULL || count == SCENARIO_LEN ||
+			(count > 0 && command->Time < commands[count - 1].Time))
+		{
+			fprintf (stderr, "%s:%d: invalid command\n", path, number);
+			fclose (file);
+			return -1;
+		}
+
+		command->Command = i;
+		++count;
+	}
+
+	fclose (file);
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Restores the heap order upwards from an entry. </summary>
+
+static void HeapUp (Emulator* emulator, unsigned int i)
+{
+	unsigned int* heap = emulator->Heap;
+	Virtual* v = emulator->Neighbors;
+
+	while (i > 0 && v[heap[(i - 1) / 2]].Next > v[heap[i]].Next)
+	{
+		unsigned int parent = (i - 1) / 2;
+		unsigned int swap = heap[parent];
+		heap[parent] = heap[i]; heap[i] = swap;
+		i = parent;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Restores the heap order downwards from an entry. </summary>
+
+static void HeapDown (Emulator* emulator, unsigned int i)
+{
+	unsigned int* heap = emulator->Heap;
+	Virtual* v = emulator->Neighbors;
+
+	while (1)
+	{
+		unsigned int least = i, child = 2 * i + 1;
+		if (child < emulator->HeapCount && v[heap[child]].Next < v[heap[least]].Next)
+			least = child;
+		if (child + 1 < emulator->HeapCount && v[heap[child + 1]].Next < v[heap[least]].Next)
+			least = child + 1;
+
+		if (least == i)
+			return;
+
+		unsigned int swap = heap[least];
+		heap[least] = heap[i]; heap[i] = swap;
+		i = least;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds a neighbor which beacons right away. </summary>
+
+static void Arrive (Emulator* emulator, unsigned long long now)
+{
+	if (emulator->Count == emulator->Size)
+		return;
+
+	unsigned int index = emulator->Count++;
+	Virtual* neighbor = &emulator->Neighbors[index];
+
+	neighbor->Interval = emulator->MinInterval + (unsigned long long)
+		(NextUniform (&emulator->Seed) * (emulator->MaxInterval - emulator->MinInterval));
+	neighbor->Sequence = (unsigned int) NDP_Random (&emulator->Seed);
+	neighbor->Next = now;
+	emulator->Present[emulator->PresentCount++] = index;
+
+	emulator->Heap[emulator->HeapCount] = index;
+	HeapUp (emulator, emulator->HeapCount++);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Silences a random present neighbor. </summary>
+/// <remarks> It stays in the heap and is dropped once its beacon is due. </remarks>
+
+static void Depart (Emulator* emulator, unsigned long long now)
+{
+	if (emulator->PresentCount == 0)
+		return;
+
+	unsigned int position = (unsigned int) (NextUniform
+		(&emulator->Seed) * emulator->PresentCount);
+
+	unsigned int index = emulator->Present[position];
+	emulator->Present[position] = emulator->Present[--emulator->PresentCount];
+
+	__atomic_store_n (&emulator->Neighbors[index].Departed, now, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Records when emulated neighbors are detected or expired. </summary>
+
+static void OnChurn (const NDP_Event* event, void* data)
+{
+	Emulator* emulator = (Emulator*) data;
+	const unsigned char* a = event->Addr.Data;
+
+	if (event->Type == NDP_NEIGHBOR_REFRESH ||
+		a[0] != sPrefix[0] || a[1] != sPrefix[1])
+		return;
+
+	unsigned int index = (unsigned int) a[2] << 24 |
+		(unsigned int) a[3] << 16 | (unsigned int) a[4] << 8 | a[5];
+
+	if (index >= emulator->Size)
+		return;
+
+	Virtual* neighbor = &emulator->Neighbors[index];
+	unsigned long long now = NDP_TimeNS();
+
+	if (event->Type == NDP_NEIGHBOR_UP && neighbor->Up == 0)
+		neighbor->Up = now;
+
+	if (event->Type == NDP_NEIGHBOR_DOWN && neighbor->Down == 0)
+	{
+		// Expiring a neighbor which still beacons is an error
+		if (__atomic_load_n (&neighbor->Departed, __ATOMIC_ACQUIRE) == 0)
+			__atomic_add_fetch (&emulator->FalseDepartures, 1, __ATOMIC_RELAXED);
+		else neighbor->Down = now;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Reports the median and tail of a set of latencies. </summary>
+
+static void ReportLatency (const char* bench, unsigned long long* times,
+	unsigned int count, unsigned int total)
+{
+	char name[32];
+	qsort (times, count, sizeof (times[0]), CompareTimes);
+
+	snprintf (name, sizeof (name), "%s_p50", bench);
+	Result ("churn", name, "neighbors", total, "ms",
+		count > 0 ? times[count / 2] * 1e-6 : 0);
+
+	snprintf (name, sizeof (name), "%s_p99", bench);
+	Result ("churn", name, "neighbors", total, "ms",
+		count > 0 ? times[(count * 99ULL) / 100] * 1e-6 : 0);
+
+	snprintf (name, sizeof (name), "%s_missed", bench);
+	Result ("churn", name, "neighbors", total, "count", total - count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Plays a churn scenario from the sender and measures how long
+///           the receiver takes to detect every arrival and departure. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int EndChurn (const char* sender, const char* receiver, const char* path)
+{
+	Command commands[SCENARIO_LEN];
+	Emulator emulator;
+	struct sockaddr_ll to;
+	NDP_State b;
+	int i, count;
+
+	if ((count = LoadScenario (path, commands)) < 0)
+		return -1;
+
+	memset (&emulator, 0, sizeof (emulator));
+	emulator.Seed = 0x9E3779B97F4A7C15ULL;
+	emulator.MinInterval = emulator.MaxInterval = NDP_BEACON_INTERVAL * 1000000ULL;
+
+	NDP_Init (&b); snprintf (b.Interface, NDP_IFNAME_LEN, "%s", receiver);
+
+	// Size the population for every arrival the scenario can make
+	double end = 0, churn = 0;
+	unsigned long long size = 64;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (i > 0) size += (unsigned long long) (2 * churn * (commands[i].Time - commands[i - 1].Time));
+		if (commands[i].Command == COMMAND_ARRIVE ) size += (unsigned long long) commands[i].First;
+		if (commands[i].Command == COMMAND_CHURN  ) churn = commands[i].First;
+		if (commands[i].Command == COMMAND_TIMEOUT) b.Timeout = (int) commands[i].First;
+		end = commands[i].Time;
+	}
+
+	emulator.Size = (unsigned int) size;
+	emulator.Neighbors = (Virtual*) calloc (size, sizeof (Virtual));
+	emulator.Present   = (unsigned int*) malloc (size * sizeof (unsigned int));
+	emulator.Heap      = (unsigned int*) malloc (size * sizeof (unsigned int));
+
+	// The receiver only listens and reports into the emulator
+	b.Silent = 1;
+	b.Backend = NDP_RECV_RING;
+	b.TableSize = (int) size;
+	b.EventCallback = OnChurn;
+	b.EventData = &emulator;
+
+	int socket = OpenSender (sender, &to);
+	NDP_Create (&b);
+
+	if (socket < 0 || b.Error != NDP_ERROR_NONE ||
+		emulator.Neighbors == NULL || emulator.Present == NULL || emulator.Heap == NULL)
+	{
+		fprintf (stderr, "%s\n", socket < 0 ? "Failed to open the sender" :
+			b.Error ? NDP_ErrorString (&b) : "Out of memory");
+		if (socket >= 0) close (socket);
+		NDP_Destroy (&b);
+		free (emulator.Neighbors); free (emulator.Present); free (emulator.Heap);
+		return -1;
+	}
+
+	NDP_Start (&b);
+
+	NDP_Addr sources[EMULATE_BATCH];
+	unsigned int sequences[EMULATE_BATCH];
+	double arrivals = 0, departures = 0;
+	unsigned long long nextArrival = ~0ULL, nextDeparture = ~0ULL;
+	unsigned long long start = NDP_TimeNS(), now = start, stop = 0;
+	int next = 0;
+
+	while (1)
+	{
+		now = NDP_TimeNS();
+		double elapsed = (now - start) * 1e-9;
+
+		// Apply the commands which are due
+		for (; next < count && commands[next].Time <= elapsed; ++next)
+		{
+			const Command* command = &commands[next];
+			unsigned int n;
+
+			switch (command->Command)
+			{
+				case COMMAND_INTERVAL:
+					emulator.MinInterval = (unsigned long long) (command->First  * 1e6);
+					emulator.MaxInterval = (unsigned long long) (command->Second * 1e6);
+					if (emulator.MaxInterval < emulator.MinInterval)
+						emulator.MaxInterval = emulator.MinInterval;
+					break;
+
+				case COMMAND_ARRIVE:
+					for (n = 0; n < (unsigned int) command->First; ++n)
+						Arrive (&emulator, now);
+					break;
+
+				case COMMAND_DEPART:
+					for (n = 0; n < (unsigned int) command->First; ++n)
+						Depart (&emulator, now);
+					break;
+
+				case COMMAND_CHURN:
+					arrivals   = command->First;
+					departures = command->Second;
+					nextArrival   = arrivals   > 0 ? now : ~0ULL;
+					nextDeparture = departures > 0 ? now : ~0ULL;
+					break;
+			}
+		}
+
+		// Keep beaconing until the last departures have expired
+		if (next == count && stop == 0)
+			stop = now + (b.Timeout + 2 * b.AgeInterval + 500) * 1000000ULL;
+
+		if (stop != 0 && now >= stop)
+			break;
+
+		// Arrivals and departures follow Poisson processes
+		while (nextArrival <= now && stop == 0)
+		{
+			Arrive (&emulator, now);
+			nextArrival += (unsigned long long) (-log (1 - NextUniform (&emulator.Seed)) / arrivals * 1e9);
+		}
+
+		while (nextDeparture <= now && stop == 0)
+		{
+			Depart (&emulator, now);
+			nextDeparture += (unsigned long long) (-log (1 - NextUniform (&emulator.Seed)) / departures * 1e9);
+		}
+
+		// Send every beacon which is due
+		int batch = 0;
+		while (emulator.HeapCount > 0 &&
+			emulator.Neighbors[emulator.Heap[0]].Next <= now)
+		{
+			unsigned int index = emulator.Heap[0];
+			Virtual* neighbor = &emulator.Neighbors[index];
+
+			// Departed neighbors leave the heap
+			if (neighbor->Departed != 0)
+			{
+				emulator.Heap[0] = emulator.Heap[--emulator.HeapCount];
+				HeapDown (&emulator, 0);
+				continue;
+			}
+
+			if (neighbor->Arrived == 0)
+				neighbor->Arrived = now;
+
+			VirtualAddr (index, &sources[batch]);
+			sequences[batch++] = neighbor->Sequence++;
+			neighbor->Last = now;
+
+			neighbor->Next += neighbor->Interval;
+			HeapDown (&emulator, 0);
+
+			if (batch == EMULATE_BATCH)
+				{ SendAs (socket, &to, sources, sequences, batch); batch = 0; }
+		}
+
+		if (batch > 0)
+			SendAs (socket, &to, sources, sequences, batch);
+
+		// Sleep until the next beacon but react to commands in time
+		unsigned long long wake = now + 1000000ULL;
+		if (emulator.HeapCount > 0 && emulator.Neighbors[emulator.Heap[0]].Next < wake)
+			wake = emulator.Neighbors[emulator.Heap[0]].Next;
+
+		struct timespec ts;
+		ts.tv_sec  = wake / 1000000000ULL;
+		ts.tv_nsec = wake % 1000000000ULL;
+		clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	// Give the receiver time to expire the last departures
+	// Stopping expires the present neighbors, so results are taken before
+	unsigned long long* up   = (unsigned long long*) malloc ((emulator.Count + 1) * sizeof (unsigned long long));
+	unsigned long long* down = (unsigned long long*) malloc ((emulator.Count + 1) * sizeof (unsigned long long));
+	unsigned int ups = 0, downs = 0, arrived = 0, departed = 0, n;
+
+	for (n = 0; n < emulator.Count; ++n)
+	{
+		Virtual* neighbor = &emulator.Neighbors[n];
+		if (neighbor->Arrived == 0)
+			continue;
+
+		++arrived;
+		if (neighbor->Up != 0)
+			up[ups++] = neighbor->Up > neighbor->Arrived ? neighbor->Up - neighbor->Arrived : 0;
+
+		if (neighbor->Departed == 0)
+			continue;
+
+		++departed;
+		// The timeout of the receiver runs from the last beacon
+		if (neighbor->Down != 0)
+			down[downs++] = neighbor->Down > neighbor->Last ? neighbor->Down - neighbor->Last : 0;
+	}
+
+	Result ("churn", "duration", "neighbors", emulator.Count, "s", end);
+	Result ("churn", "present", "neighbors", emulator.Count, "count", emulator.PresentCount);
+	ReportLatency ("arrival",   up,   ups,   arrived );
+	ReportLatency ("departure", down, downs, departed);
+	Result ("churn", "false_departures", "neighbors", emulator.Count, "count",
+		emulator.FalseDepartures);
+
+	close (socket);
+	NDP_Destroy (&b);
+	free (up); free (down);
+	free (emulator.Neighbors); free (emulator.Present); free (emulator.Heap);
+	return 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Main                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Main execution point for the benchmarks. </summary>
+/// <returns> Zero for success, error code for failure. </returns>
+
+int main (int argc, char** argv)
+{
+	unsigned int i;
+
+	// Run the table microbenchmarks
+	if (argc == 2 && strcmp (argv[1], "micro") == 0)
+	{
+		for (i = 0; i < sizeof (sSizes) / sizeof (sSizes[0]); ++i)
+			MicroTable (sSizes[i]);
+
+		return 0;
+	}
+
+	// Run the benchmarks over a link
+	if (argc == 4 && strcmp (argv[1], "e2e") == 0)
+	{
+		if (EndDiscovery   (argv[2], argv[3]   ) < 0 ||
+			EndThroughput  (argv[2], argv[3]   ) < 0 ||
+			EndWireLatency (argv[2], argv[3], 0) < 0 ||
+			EndWireLatency (argv[2], argv[3], 1) < 0)
+			return 1;
+
+		return 0;
+	}
+
+	// Play a churn scenario over a link
+	if (argc == 5 && strcmp (argv[1], "churn") == 0)
+		return EndChurn (argv[2], argv[3], argv[4]) < 0 ? 1 : 0;
+
+	fprintf (stderr, "Usage: %s micro | e2e SENDER RECEIVER |"
+		" churn SENDER RECEIVER SCENARIO\n", argv[0]);
+	return 1;
+}
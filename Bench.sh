@@ -0,0 +1,34 @@
+#!/bin/sh
+################################################################################
+## -------------------------------------------------------------------------- ##
+##                                                                            ##
+##                          Copyright (C) 2012-2013                           ##
+##                            github.com/dkrutsko                             ##
+##                            github.com/Harrold                              ##
+##                            github.com/AbsMechanik                          ##
+##                                                                            ##
+##                        See LICENSE.md for copyright                        ##
+##                                                                            ##
+## -------------------------------------------------------------------------- ##
+################################################################################
+
+## Runs the end to end benchmarks over a veth pair inside a private network
+## namespace, so nothing on the host is touched. Requires root and iproute2.
+
+NS=ndpbench
+
+if [ "$(id -u)" -ne 0 ] || ! command -v ip > /dev/null; then
+	echo "Skipping end to end benchmarks, root and iproute2 are required" >&2
+	exit 0
+fi
+
+ip netns del $NS 2> /dev/null
+ip netns add $NS || exit 1
+trap "ip netns del $NS" EXIT
+
+ip netns exec $NS ip link add ndp0 type veth peer name ndp1 &&
+ip netns exec $NS ip link set ndp0 up &&
+ip netns exec $NS ip link set ndp1 up || exit 1
+
+ip netns exec $NS ./Bench e2e ndp0 ndp1
+ip netns exec $NS ./Bench churn ndp0 ndp1 Churn.txt
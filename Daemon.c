@@ -0,0 +1,739 @@
+////////////////////////////////////////////////////////////////////////////////
+// -------------------------------------------------------------------------- //
+//                                                                            //
+//                          Copyright (C) 2012-2013                           //
+//                            github.com/dkrutsko                             //
+//                            github.com/Harrold                              //
+//                            github.com/AbsMechanik                          //
+//                                                                            //
+//                        See LICENSE.md for copyright                        //
+//                                                                            //
+// -------------------------------------------------------------------------- //
+////////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------//
+// Prefaces                                                                   //
+//----------------------------------------------------------------------------//
+
+#define _GNU_SOURCE
+#include "NDP.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+
+
+
+//----------------------------------------------------------------------------//
+// Locals                                                                     //
+//----------------------------------------------------------------------------//
+
+// Maximum number of interfaces served at once
+#define MAX_INTERFACES 8
+
+// Maximum number of clients connected at once
+#define MAX_CLIENTS 256
+
+// Maximum length of a request line
+#define MAX_REQUEST 128
+
+// Maximum pending response bytes before a client is dropped
+#define MAX_OUTPUT (64 << 20)
+
+// Default path of the query socket
+#define DEFAULT_SOCKET "/run/metropolis.sock"
+
+// Epoll tags of the non-client sources
+#define TAG_LISTEN (~0ULL)
+#define TAG_SIGNAL (~1ULL)
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a connected query client. </summary>
+
+typedef struct
+{
+	int Socket;					// Client socket or -1 if free
+	char In[MAX_REQUEST];		// Partial request line
+	unsigned int InLen;			// Bytes in the request line
+
+	char* Out;					// Pending response bytes
+	size_t OutLen;				// Bytes in the response
+	size_t OutPos;				// Bytes already written
+	size_t OutSize;				// Allocated response bytes
+	char Overflow;				// Response outgrew MAX_OUTPUT
+
+} Client;
+
+static NDP_State gStates[MAX_INTERFACES];
+static int gCount = 0;
+
+static Client gClients[MAX_CLIENTS];
+static int gEpoll = -1;
+
+
+
+//----------------------------------------------------------------------------//
+// Responses                                                                  //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Appends a formatted line to the response of a client. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int Reply (Client* client, const char* format, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static int Reply (Client* client, const char* format, ...)
+{
+	va_list args;
+	int length;
+
+	while (1)
+	{
+		size_t space = client->OutSize - client->OutLen;
+
+		va_start (args, format);
+		length = vsnprintf (client->Out +
+			client->OutLen, space, format, args);
+		va_end (args);
+
+		if (length < 0)
+			return -1;
+
+		if ((size_t) length < space)
+			{ client->OutLen += length; return 0; }
+
+		// Grow the response buffer
+		size_t size = client->OutSize ?
+			client->OutSize * 2 : 4096;
+		while (size - client->OutLen <= (size_t) length)
+			size *= 2;
+
+		// Drop clients which do not read their responses
+		if (size > MAX_OUTPUT)
+			{ client->Overflow = 1; return -1; }
+
+		char* out = (char*) realloc (client->Out, size);
+		if (out == NULL)
+			return -1;
+
+		client->Out = out;
+		client->OutSize = size;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Appends a neighbor line to the response of a client. </summary>
+
+static int ReplyEntry (Client* client, const NDP_State* state,
+	const NDP_Entry* entry, unsigned long long time)
+{
+	return Reply (client, "%s %s %llu %lld %u %u %u %u\n",
+		state->Interface, NDP_AddrString (&entry->Addr), time - entry->Seen,
+		(long long) (entry->Seen + state->Timeout) - (long long) time,
+		entry->Link.Received, entry->Link.Lost,
+		entry->Link.Interval, entry->Link.Jitter);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Parses a neighbor address in the colon separated form. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int ParseAddr (const char* text, NDP_Addr* addr)
+{
+	unsigned int data[NDP_ADDR_LEN];
+	int i, used = 0;
+
+	if (sscanf (text, "%2x:%2x:%2x:%2x:%2x:%2x%n", &data[0], &data[1],
+		&data[2], &data[3], &data[4], &data[5], &used) != NDP_ADDR_LEN ||
+		text[used] != 0)
+		return -1;
+
+	for (i = 0; i < NDP_ADDR_LEN; ++i)
+		addr->Data[i] = (unsigned char) data[i];
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Executes a single request line of a client. </summary>
+/// <remarks> Requests are answered from the published snapshots, so
+///           clients never contend with the receive path. </remarks>
+
+static void Execute (Client* client, char* line)
+{
+	unsigned long long time = NDP_Time();
+	char* command = strtok (line, " \t\r");
+	char* argument = strtok (NULL, " \t\r");
+	NDP_View view;
+	NDP_Addr addr;
+	int i, j, k;
+
+	if (command == NULL)
+		return;
+
+	// Dump every neighbor of every interface
+	if (strcasecmp (command, "LIST") == 0)
+	{
+		for (k = 0; k < gCount; ++k)
+		{
+			if (argument != NULL && strcmp
+				(argument, gStates[k].Interface) != 0)
+				continue;
+
+			NDP_AcquireView (&gStates[k], &view);
+			for (i = 0; i < view.Count; ++i)
+			for (j = 0; j < (int) view.Shards[i]->Count; ++j)
+				ReplyEntry (client, &gStates[k],
+					&view.Shards[i]->Entries[j], time);
+
+			NDP_ReleaseView (&view);
+		}
+
+		Reply (client, ".\n");
+	}
+
+	// Look up a single neighbor
+	else if (strcasecmp (command, "GET") == 0)
+	{
+		if (argument == NULL || ParseAddr (argument, &addr) < 0)
+			{ Reply (client, "ERROR Invalid address\n"); return; }
+
+		for (k = 0; k < gCount; ++k)
+		{
+			NDP_AcquireView (&gStates[k], &view);
+			for (i = 0; i < view.Count; ++i)
+			for (j = 0; j < (int) view.Shards[i]->Count; ++j)
+			{
+				const NDP_Entry* entry = &view.Shards[i]->Entries[j];
+				if (memcmp (&entry->Addr, &addr, sizeof (addr)) == 0)
+					ReplyEntry (client, &gStates[k], entry, time);
+			}
+
+			NDP_ReleaseView (&view);
+		}
+
+		Reply (client, ".\n");
+	}
+
+	// Count the neighbors of every interface
+	else if (strcasecmp (command, "COUNT") == 0)
+	{
+		for (k = 0; k < gCount; ++k)
+		{
+			NDP_AcquireView (&gStates[k], &view);
+			Reply (client, "%s %u\n", gStates[k].Interface, view.Total);
+			NDP_ReleaseView (&view);
+		}
+
+		Reply (client, ".\n");
+	}
+
+	// Describe the served interfaces
+	else if (strcasecmp (command, "INFO") == 0)
+	{
+		for (k = 0; k < gCount; ++k)
+			Reply (client, "%s %d %d %s\n", gStates[k].Interface,
+				gStates[k].IfIndex, gStates[k].MTU,
+				NDP_AddrString (&gStates[k].Addr));
+
+		Reply (client, ".\n");
+	}
+
+	else Reply (client, "ERROR Unknown command\n");
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Clients                                                                    //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Disconnects a client and releases its buffers. </summary>
+
+static void CloseClient (Client* client)
+{
+	close (client->Socket);
+	free (client->Out);
+
+	memset (client, 0, sizeof (Client));
+	client->Socket = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Writes as much of the pending response as possible. </summary>
+/// <returns> Zero for success, negative one if the client is gone. </returns>
+
+static int FlushClient (Client* client)
+{
+	while (client->OutPos < client->OutLen)
+	{
+		ssize_t length = send (client->Socket, client->Out +
+			client->OutPos, client->OutLen - client->OutPos, MSG_NOSIGNAL);
+
+		if (length < 0)
+			return errno == EAGAIN ? 0 : -1;
+
+		client->OutPos += length;
+	}
+
+	client->OutLen = 0;
+	client->OutPos = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Reads and executes every complete request of a client. </summary>
+/// <remarks> Clients which stop sending are closed once their responses are
+///           written, clients which stop reading once these overflow. </remarks>
+/// <returns> Zero for success, negative one if the client is gone. </returns>
+
+static int ReadClient (Client* client)
+{
+	char buffer[1024];
+	ssize_t length, i;
+
+	while ((length = recv (client->Socket, buffer, sizeof (buffer), 0)) > 0)
+	{
+		for (i = 0; i < length; ++i)
+		{
+			if (buffer[i] != '\n')
+			{
+				// Drop lines which are too long
+				if (client->InLen < MAX_REQUEST - 1)
+					client->In[client->InLen++] = buffer[i];
+				continue;
+			}
+
+			client->In[client->InLen] = 0;
+			client->InLen = 0;
+			Execute (client, client->In);
+
+			if (client->Overflow != 0)
+				return -1;
+		}
+	}
+
+	// Still answer clients which shut down their sending side
+	if (length == 0)
+		return FlushClient (client) < 0 || client->OutLen == 0 ? -1 : 0;
+
+	if (errno != EAGAIN)
+		return -1;
+
+	return FlushClient (client);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Accepts every pending client connection. </summary>
+
+static void AcceptClients (int listener)
+{
+	int socket, i;
+	while ((socket = accept4 (listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		// Find a free client
+		for (i = 0; i < MAX_CLIENTS; ++i)
+			if (gClients[i].Socket < 0) break;
+
+		if (i == MAX_CLIENTS)
+			{ close (socket); continue; }
+
+		struct epoll_event event;
+		event.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+		event.data.u64 = i;
+
+		if (epoll_ctl (gEpoll, EPOLL_CTL_ADD, socket, &event) < 0)
+			{ close (socket); continue; }
+
+		gClients[i].Socket = socket;
+	}
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Daemon                                                                     //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prints the command line options to the standard error. </summary>
+
+static void Usage (const char* name)
+{
+	fprintf (stderr,
+		"Usage: %s [options]\n"
+		"  -i, --interface NAME   Interface to serve (repeatable, default ra0)\n"
+		"  -b, --beacon MS        Beacon interval (default %d)\n"
+		"  -A, --adaptive         Adapt the beacon interval to the neighborhood\n"
+		"  -m, --trickle-min MS   Shortest adaptive interval (default %d)\n"
+		"  -M, --trickle-max MS   Longest adaptive interval (default %d)\n"
+		"  -K, --redundancy N     Beacons heard which suppress ours (default %d)\n"
+		"  -a, --age MS           Aging interval (default %d)\n"
+		"  -t, --timeout MS       Neighbor timeout (default %d)\n"
+		"  -p, --publish MS       Snapshot interval (default %d)\n"
+		"  -n, --table-size N     Expected neighbors (default %d)\n"
+		"  -l, --table-limit N    Maximum neighbors, zero for none (default 0)\n"
+		"  -k, --shards N         Receive shards (default 1)\n"
+		"  -r, --backend NAME     Receive backend: socket, ring or batch\n"
+		"  -P, --promisc          Enable promiscuous mode\n"
+		"  -L, --low-latency      Poll the socket and bypass the qdisc\n"
+		"  -C, --cpu CPU          Pin the engine thread, shards use the next CPUs\n"
+		"  -F, --fifo PRIORITY    Run the threads under SCHED_FIFO\n"
+		"  -T, --timestamps       Measure the wire to table latency\n"
+		"  -s, --socket PATH      Query socket (default %s)\n"
+		"  -c, --capture PATH     Write accepted beacons to a pcap file\n"
+		"  -f, --persist PATH     Keep the table in a file across restarts\n"
+		"  -x, --export NAME      Export the table to shared memory\n"
+		"  -R, --replay PATH      Replay a pcap file instead of serving\n"
+		"  -w, --paced            Replay at the recorded speed\n",
+		name, NDP_BEACON_INTERVAL, NDP_TRICKLE_MIN, NDP_TRICKLE_MAX,
+		NDP_TRICKLE_REDUNDANCY, NDP_AGE_INTERVAL, NDP_TIMEOUT,
+		NDP_PUBLISH_INTERVAL, NDP_TABLE_LEN, DEFAULT_SOCKET);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the listening query socket. </summary>
+/// <returns> The socket or negative one for failure. </returns>
+
+static int Listen (const char* path)
+{
+	struct sockaddr_un addr;
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+
+	if (strlen (path) >= sizeof (addr.sun_path))
+		return -1;
+
+	strcpy (addr.sun_path, path);
+	unlink (path);
+
+	int listener = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listener < 0)
+		return -1;
+
+	if (bind (listener, (struct sockaddr*) &addr, sizeof (addr)) < 0 ||
+		listen (listener, 64) < 0)
+		{ close (listener); return -1; }
+
+	return listener;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Compares two neighbor entries by address. </summary>
+
+static int CompareEntries (const void* a, const void* b)
+{
+	return memcmp (&((const NDP_Entry*) a)->Addr,
+				   &((const NDP_Entry*) b)->Addr, sizeof (NDP_Addr));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Replays a capture and prints the throughput and the
+///           final table, sorted so that runs can be compared. </summary>
+/// <returns> Zero for success, error code for failure. </returns>
+
+static int Replay (NDP_State* state, const char* path, int paced)
+{
+	unsigned int i;
+
+	NDP_CreateOffline (state, 0);
+	if (state->Error != NDP_ERROR_NONE)
+	{
+		fprintf (stderr, "%s\n", NDP_ErrorString (state));
+		return 1;
+	}
+
+	// Replay every beacon on the simulated clock
+	unsigned long long start = NDP_Time();
+	long long count = NDP_Replay (state, path, paced);
+	double elapsed = (NDP_Time() - start) * 1e-3;
+
+	if (count < 0)
+	{
+		fprintf (stderr, "%s: Failed to read the capture\n", path);
+		NDP_Destroy (state);
+		return 1;
+	}
+
+	const NDP_Snapshot* snapshot = NDP_AcquireSnapshot (state);
+	NDP_Entry* entries = (NDP_Entry*) malloc
+		((snapshot->Count + 1) * sizeof (NDP_Entry));
+
+	if (entries == NULL)
+	{
+		fprintf (stderr, "%s: Failed to allocate the table\n", path);
+		NDP_ReleaseSnapshot (snapshot);
+		NDP_Destroy (state);
+		return 1;
+	}
+
+	memcpy (entries, snapshot->Entries, snapshot->Count * sizeof (NDP_Entry));
+	qsort (entries, snapshot->Count, sizeof (NDP_Entry), CompareEntries);
+
+	// Print the summary followed by the table in the LIST format
+	printf ("# frames %lld seconds %.3f frames/s %.0f neighbors %u\n", count,
+		elapsed, elapsed > 0 ? count / elapsed : 0.0, snapshot->Count);
+
+	for (i = 0; i < snapshot->Count; ++i)
+		printf ("replay %s %llu %lld %u %u %u %u\n", NDP_AddrString (&entries[i].Addr),
+			snapshot->Time - entries[i].Seen, (long long) (entries[i].Seen +
+			state->Timeout) - (long long) snapshot->Time, entries[i].Link.Received,
+			entries[i].Link.Lost, entries[i].Link.Interval, entries[i].Link.Jitter);
+
+	free (entries);
+	NDP_ReleaseSnapshot (snapshot);
+	NDP_Destroy (state);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Main execution point for the daemon. </summary>
+/// <returns> Zero for success, error code for failure. </returns>
+
+int main (int argc, char** argv)
+{
+	static const struct option options[] =
+	{
+		{ "interface",   required_argument, NULL, 'i' },
+		{ "beacon",      required_argument, NULL, 'b' },
+		{ "adaptive",    no_argument,       NULL, 'A' },
+		{ "trickle-min", required_argument, NULL, 'm' },
+		{ "trickle-max", required_argument, NULL, 'M' },
+		{ "redundancy",  required_argument, NULL, 'K' },
+		{ "age",         required_argument, NULL, 'a' },
+		{ "timeout",     required_argument, NULL, 't' },
+		{ "publish",     required_argument, NULL, 'p' },
+		{ "table-size",  required_argument, NULL, 'n' },
+		{ "table-limit", required_argument, NULL, 'l' },
+		{ "shards",      required_argument, NULL, 'k' },
+		{ "backend",     required_argument, NULL, 'r' },
+		{ "promisc",     no_argument,       NULL, 'P' },
+		{ "low-latency", no_argument,       NULL, 'L' },
+		{ "cpu",         required_argument, NULL, 'C' },
+		{ "fifo",        required_argument, NULL, 'F' },
+		{ "timestamps",  no_argument,       NULL, 'T' },
+		{ "socket",      required_argument, NULL, 's' },
+		{ "capture",     required_argument, NULL, 'c' },
+		{ "persist",     required_argument, NULL, 'f' },
+		{ "export",      required_argument, NULL, 'x' },
+		{ "replay",      required_argument, NULL, 'R' },
+		{ "paced",       no_argument,       NULL, 'w' },
+		{ "help",        no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	const char* path = DEFAULT_SOCKET;
+	const char* capture = NULL;
+	const char* persist = NULL;
+	const char* export = NULL;
+	const char* replay = NULL;
+	int paced = 0;
+	const char* interfaces[MAX_INTERFACES];
+	NDP_State config;
+	int option, i, k;
+
+	NDP_Init (&config);
+
+	// Parse the command line
+	while ((option = getopt_long (argc, argv,
+		"i:b:Am:M:K:a:t:p:n:l:k:r:PLC:F:Ts:c:f:x:R:wh", options, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 'i':
+				if (gCount < MAX_INTERFACES)
+					interfaces[gCount++] = optarg;
+				break;
+
+			case 'b': config.BeaconInterval  = atoi (optarg); break;
+			case 'A': config.Adaptive        = 1;             break;
+			case 'm': config.TrickleMin      = atoi (optarg); break;
+			case 'M': config.TrickleMax      = atoi (optarg); break;
+			case 'K': config.TrickleRedundancy = atoi (optarg); break;
+			case 'a': config.AgeInterval     = atoi (optarg); break;
+			case 't': config.Timeout         = atoi (optarg); break;
+			case 'p': config.PublishInterval = atoi (optarg); break;
+			case 'n': config.TableSize       = atoi (optarg); break;
+			case 'l': config.TableLimit      = atoi (optarg); break;
+			case 'k': config.Shards          = atoi (optarg); break;
+			case 'P': config.Promisc         = 1;             break;
+			case 'L': config.LowLatency      = 1;             break;
+			case 'C': config.RecvCPU         = atoi (optarg); break;
+			case 'F': config.Priority        = atoi (optarg); break;
+			case 'T': config.Timestamps      = 1;             break;
+			case 's': path                   = optarg;        break;
+			case 'c': capture                = optarg;        break;
+			case 'f': persist                = optarg;        break;
+			case 'x': export                 = optarg;        break;
+			case 'R': replay                 = optarg;        break;
+			case 'w': paced                  = 1;             break;
+
+			case 'r':
+				if      (strcmp (optarg, "socket") == 0) config.Backend = NDP_RECV_SOCKET;
+				else if (strcmp (optarg, "ring"  ) == 0) config.Backend = NDP_RECV_RING;
+				else if (strcmp (optarg, "batch" ) == 0) config.Backend = NDP_RECV_BATCH;
+				else { Usage (argv[0]); return 1; }
+				break;
+
+			default:
+				Usage (argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
+
+	// Replay a capture without any sockets
+	if (replay != NULL)
+		return Replay (&config, replay, paced);
+
+	if (gCount == 0)
+		interfaces[gCount++] = "ra0";
+
+	// Create a state for every interface
+	NDP_State* active[MAX_INTERFACES];
+	char captures[MAX_INTERFACES][256];
+	char persists[MAX_INTERFACES][256];
+	char exports[MAX_INTERFACES][256];
+	for (k = 0; k < gCount; ++k)
+	{
+		gStates[k] = config;
+		snprintf (gStates[k].Interface, NDP_IFNAME_LEN, "%s", interfaces[k]);
+
+		// Interfaces capture to separate files
+		if (capture != NULL)
+		{
+			if (gCount == 1)
+				 snprintf (captures[k], sizeof (captures[k]), "%s", capture);
+			else snprintf (captures[k], sizeof (captures[k]), "%s.%s", capture, interfaces[k]);
+			gStates[k].CapturePath = captures[k];
+		}
+
+		// And keep their tables in separate files
+		if (persist != NULL)
+		{
+			if (gCount == 1)
+				 snprintf (persists[k], sizeof (persists[k]), "%s", persist);
+			else snprintf (persists[k], sizeof (persists[k]), "%s.%s", persist, interfaces[k]);
+			gStates[k].PersistPath = persists[k];
+		}
+
+		// And export to separate segments
+		if (export != NULL)
+		{
+			if (gCount == 1)
+				 snprintf (exports[k], sizeof (exports[k]), "%s", export);
+			else snprintf (exports[k], sizeof (exports[k]), "%s.%s", export, interfaces[k]);
+			gStates[k].ExportName = exports[k];
+		}
+
+		active[k] = &gStates[k];
+		NDP_Create (&gStates[k]);
+
+		if (gStates[k].Error != NDP_ERROR_NONE)
+		{
+			fprintf (stderr, "%s: %s\n", gStates[k].Interface,
+				NDP_ErrorString (&gStates[k]));
+
+			for (i = 0; i <= k; ++i)
+				NDP_Destroy (&gStates[i]);
+			return 1;
+		}
+	}
+
+	// Handle termination through the event loop
+	sigset_t signals;
+	sigemptyset (&signals);
+	sigaddset (&signals, SIGINT);
+	sigaddset (&signals, SIGTERM);
+	sigaddset (&signals, SIGHUP);
+	pthread_sigmask (SIG_BLOCK, &signals, NULL);
+
+	for (i = 0; i < MAX_CLIENTS; ++i)
+		gClients[i].Socket = -1;
+
+	int listener = Listen (path);
+	int terminate = signalfd (-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	gEpoll = epoll_create1 (EPOLL_CLOEXEC);
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+
+	event.data.u64 = TAG_LISTEN;
+	if (listener < 0 || terminate < 0 || gEpoll < 0 ||
+		epoll_ctl (gEpoll, EPOLL_CTL_ADD, listener, &event) < 0 ||
+		(event.data.u64 = TAG_SIGNAL, epoll_ctl
+		(gEpoll, EPOLL_CTL_ADD, terminate, &event)) < 0)
+	{
+		fprintf (stderr, "%s: Failed to create the query socket\n", path);
+		for (k = 0; k < gCount; ++k)
+			NDP_Destroy (&gStates[k]);
+		return 1;
+	}
+
+	// Serve every interface from a single engine, created
+	// after blocking signals so that its thread inherits it
+	NDP_Engine engine;
+	NDP_EngineStart (&engine, active, gCount);
+	if (engine.Error != NDP_ERROR_NONE)
+	{
+		gStates[0].Error = engine.Error;
+		fprintf (stderr, "%s\n", NDP_ErrorString (&gStates[0]));
+
+		for (k = 0; k < gCount; ++k)
+			NDP_Destroy (&gStates[k]);
+		return 1;
+	}
+
+	// Serve queries until terminated
+	struct epoll_event events[64];
+	int running = 1;
+
+	while (running)
+	{
+		int count = epoll_wait (gEpoll, events, 64, -1);
+		for (i = 0; i < count; ++i)
+		{
+			if (events[i].data.u64 == TAG_SIGNAL)
+				running = 0;
+
+			else if (events[i].data.u64 == TAG_LISTEN)
+				AcceptClients (listener);
+
+			else
+			{
+				Client* client = &gClients[events[i].data.u64];
+				if (client->Socket < 0) continue;
+
+				if ((events[i].events & (EPOLLERR | EPOLLHUP)) ||
+					FlushClient (client) < 0 || ReadClient (client) < 0)
+					CloseClient (client);
+			}
+		}
+	}
+
+	// Release everything
+	for (i = 0; i < MAX_CLIENTS; ++i)
+		if (gClients[i].Socket >= 0)
+			CloseClient (&gClients[i]);
+
+	NDP_EngineStop (&engine);
+	for (k = 0; k < gCount; ++k)
+		NDP_Destroy (&gStates[k]);
+
+	close (gEpoll);
+	close (terminate);
+	close (listener);
+	unlink (path);
+	return 0;
+}
@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////////////////
+// -------------------------------------------------------------------------- //
+//                                                                            //
+//                          Copyright (C) 2012-2013                           //
+//                            github.com/dkrutsko                             //
+//                            github.com/Harrold                              //
+//                            github.com/AbsMechanik                          //
+//                                                                            //
+//                        See LICENSE.md for copyright                        //
+//                                                                            //
+// -------------------------------------------------------------------------- //
+////////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------//
+// Prefaces                                                                   //
+//----------------------------------------------------------------------------//
+
+#include "NDP.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+
+
+//----------------------------------------------------------------------------//
+// Dump                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prints the counters read from the segments. </summary>
+
+static void DumpStats (const NDP_Reader* reader)
+{
+	const NDP_Stats* stats = &reader->Stats;
+
+	printf ("%s frames_received %llu\n",    reader->Interface, stats->FramesReceived);
+	printf ("%s frames_filtered %llu\n",    reader->Interface, stats->FramesFiltered);
+	printf ("%s beacons_accepted %llu\n",   reader->Interface, stats->BeaconsAccepted);
+	printf ("%s table_drops %llu\n",        reader->Interface, stats->TableDrops);
+	printf ("%s inserts %llu\n",            reader->Interface, stats->Inserts);
+	printf ("%s expiries %llu\n",           reader->Interface, stats->Expiries);
+	printf ("%s beacons_sent %llu\n",       reader->Interface, stats->BeaconsSent);
+	printf ("%s send_errors %llu\n",        reader->Interface, stats->SendErrors);
+	printf ("%s beacons_suppressed %llu\n", reader->Interface, stats->BeaconsSuppressed);
+
+	// Only states recording timestamps measure the wire latency
+	if (NDP_Percentile (stats->WireLatency, 1.00) > 0)
+	{
+		printf ("%s wire_p50_ns %llu\n", reader->Interface, NDP_Percentile (stats->WireLatency, 0.50));
+		printf ("%s wire_p99_ns %llu\n", reader->Interface, NDP_Percentile (stats->WireLatency, 0.99));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prints the interface and the neighbors read from the segments. </summary>
+/// <remarks> Neighbor lines use the format of the daemon. </remarks>
+
+static void Dump (const NDP_Reader* reader, int stats)
+{
+	unsigned long long time = NDP_Time();
+	unsigned int i;
+
+	printf ("%s %d %d %s\n", reader->Interface, reader->IfIndex,
+		reader->MTU, NDP_AddrString (&reader->Addr));
+
+	if (stats != 0)
+		DumpStats (reader);
+
+	for (i = 0; i < reader->Count; ++i)
+	{
+		const NDP_Entry* entry = &reader->Entries[i];
+		printf ("%s %s %llu %lld %u %u %u %u\n",
+			reader->Interface, NDP_AddrString (&entry->Addr), time - entry->Seen,
+			(long long) (entry->Seen + reader->Timeout) - (long long) time,
+			entry->Link.Received, entry->Link.Lost,
+			entry->Link.Interval, entry->Link.Jitter);
+	}
+
+	printf (".\n");
+	fflush (stdout);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Main                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prints the command line options. </summary>
+
+static void Usage (const char* name)
+{
+	fprintf (stderr,
+		"Usage: %s [options] NAME\n"
+		"  NAME                   Shared memory segment given to --export\n"
+		"  -s, --stats            Print the counters as well\n"
+		"  -w, --watch MS         Dump again every MS milliseconds\n", name);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Main execution point for the dump tool. </summary>
+/// <returns> Zero for success, error code for failure. </returns>
+
+int main (int argc, char** argv)
+{
+	static const struct option options[] =
+	{
+		{ "stats", no_argument,       NULL, 's' },
+		{ "watch", required_argument, NULL, 'w' },
+		{ "help",  no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	NDP_Reader reader;
+	int option, stats = 0, watch = 0;
+
+	// Parse the command line
+	while ((option = getopt_long (argc, argv, "sw:h", options, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 's': stats = 1;             break;
+			case 'w': watch = atoi (optarg); break;
+
+			default:
+				Usage (argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1)
+		{ Usage (argv[0]); return 1; }
+
+	if (NDP_OpenReader (&reader, argv[optind]) < 0)
+	{
+		fprintf (stderr, "%s: Failed to open the shared memory segment\n", argv[optind]);
+		return 1;
+	}
+
+	while (1)
+	{
+		if (NDP_ReadExport (&reader) < 0)
+		{
+			fprintf (stderr, "%s: The exporting state is gone\n", argv[optind]);
+			NDP_CloseReader (&reader);
+			return 1;
+		}
+
+		Dump (&reader, stats);
+		if (watch <= 0)
+			break;
+
+		struct timespec delay;
+		delay.tv_sec  =  watch / 1000;
+		delay.tv_nsec = (watch % 1000) * 1000000L;
+		nanosleep (&delay, NULL);
+	}
+
+	NDP_CloseReader (&reader);
+	return 0;
+}
@@ -15,11 +15,15 @@
 // Prefaces                                                                   //
 //----------------------------------------------------------------------------//
 
+#define _GNU_SOURCE
 #include "NDP.h"
 
 #include <time.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <curses.h>
+#include <getopt.h>
 #include <unistd.h>
 
 
@@ -31,6 +35,15 @@
 static int gX = 0; // Terminal X position of center
 static int gY = 0; // Terminal Y position of center
 
+// Maximum number of interfaces served at once
+#define MAX_INTERFACES 8
+
+// Receive shards of every interface
+static int gShards = 1;
+
+// Whether to measure the wire to table latency
+static char gTimestamps = 0;
+
 // Color identifiers
 enum
 {
@@ -42,6 +55,397 @@ enum
 
 
 
+//----------------------------------------------------------------------------//
+// Table                                                                      //
+//----------------------------------------------------------------------------//
+
+// Maximum number of table lines on the screen
+#define MAX_LINES 256
+
+// Width of a table line
+#define LINE_LEN 72
+
+// Time between sorts by a changing column (ms)
+#define RESORT_INTERVAL 1000
+
+// Orders in which the table is sorted
+enum
+{
+	SORT_ADDRESS,
+	SORT_INTERFACE,
+	SORT_SEEN,
+	SORT_EXPIRY,
+	SORT_LOSS,
+	SORT_COUNT,
+};
+
+static const char* sSortNames[SORT_COUNT] =
+{
+	"ADDRESS", "INTERFACE", "LAST SEEN", "EXPIRES IN", "LOSS"
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single neighbor row of the table. </summary>
+
+typedef struct
+{
+	NDP_Addr Addr;				// Neighbor address
+	unsigned long long Seen;	// Time last seen
+	unsigned long long Expiry;	// Time of expiry
+	NDP_Link Link;				// Quality of the link
+	NDP_State* State;			// Interface of the neighbor
+
+	unsigned int Shard;			// Shard of the snapshot entry
+	unsigned int Index;			// Index of the snapshot entry
+
+} Row;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the scrollable, sorted and filtered table. </summary>
+
+typedef struct
+{
+	Row* Rows;					// Rows which pass the filter
+	unsigned int Count;			// Number of rows
+	unsigned int Size;			// Allocated rows
+	unsigned int Total;			// Neighbors before filtering
+
+	int Top;					// First row on the screen
+	int Sort;					// One of the sort orders
+	char Reverse;				// Whether to reverse the order
+	char Links;					// Whether to show link quality
+	char Filter[24];			// Substring rows must contain
+
+	unsigned long long Version;	// Sum of snapshot versions
+	unsigned long long Layout;	// Sum of snapshot layouts
+	unsigned long long Sorted;	// Time of the last sort (ms)
+	char Stale;					// Whether to rebuild the rows
+
+	// Text currently shown on every table line
+	char Lines[MAX_LINES][LINE_LEN];
+
+} Table;
+
+static Table gTable;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the share of beacons lost on a link in percent. </summary>
+
+static double LinkLoss (const NDP_Link* link)
+{
+	unsigned int total = link->Received + link->Lost;
+	return total > 0 ? link->Lost * 100.0 / total : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Compares two rows in the current sort order. </summary>
+
+static int CompareRows (const void* a, const void* b)
+{
+	const Row* x = (const Row*) a;
+	const Row* y = (const Row*) b;
+	int result = 0;
+
+	switch (gTable.Sort)
+	{
+		case SORT_INTERFACE:
+			result = strcmp (x->State->Interface, y->State->Interface);
+			break;
+
+		case SORT_SEEN:
+			// Most recently seen first
+			result = (x->Seen < y->Seen) - (x->Seen > y->Seen);
+			break;
+
+		case SORT_EXPIRY:
+			result = (x->Expiry > y->Expiry) - (x->Expiry < y->Expiry);
+			break;
+
+		case SORT_LOSS:
+			// Worst links first
+			result = (LinkLoss (&x->Link) < LinkLoss (&y->Link)) -
+					 (LinkLoss (&x->Link) > LinkLoss (&y->Link));
+			break;
+	}
+
+	// Break ties by address
+	if (result == 0)
+		result = memcmp (&x->Addr, &y->Addr, sizeof (NDP_Addr));
+
+	return gTable.Reverse ? -result : result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Checks whether a row contains the filter. </summary>
+
+static int FilterRow (const Row* row)
+{
+	char text[NDP_IFNAME_LEN + 20];
+	snprintf (text, sizeof (text), "%s %s",
+		row->State->Interface, NDP_AddrString (&row->Addr));
+
+	return strcasestr (text, gTable.Filter) != NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Copies the snapshot entry of a row into the row. </summary>
+
+static void FillRow (Row* row, const NDP_Entry* entry)
+{
+	row->Addr   = entry->Addr;
+	row->Seen   = entry->Seen;
+	row->Expiry = entry->Seen + row->State->Timeout;
+	row->Link   = entry->Link;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Rebuilds the rows when neighbors came or went and refreshes
+///           the visible rows otherwise. </summary>
+/// <remarks> Entries keep their index in the snapshots until the layout
+///           changes, so refreshes only copy the rows on the screen. Rows
+///           sorted by a column that refreshes change are sorted again
+///           at most every RESORT_INTERVAL. </remarks>
+
+static void BuildRows (NDP_State* states, int count, int lines)
+{
+	NDP_View views[MAX_INTERFACES];
+	unsigned long long version = 0;
+	unsigned long long layout  = 0;
+	unsigned long long time = NDP_Time();
+	unsigned int total = 0;
+	int i, j, k;
+
+	for (k = 0; k < count; ++k)
+	{
+		NDP_AcquireView (&states[k], &views[k]);
+		for (i = 0; i < views[k].Count; ++i)
+		{
+			version += views[k].Shards[i]->Version;
+			layout  += views[k].Shards[i]->Layout;
+		}
+
+		total += views[k].Total;
+	}
+
+	// Only the address and interface do not change with refreshes
+	char moving = gTable.Sort != SORT_ADDRESS && gTable.Sort != SORT_INTERFACE;
+
+	if (gTable.Stale || layout != gTable.Layout || (moving &&
+		version != gTable.Version && time - gTable.Sorted >= RESORT_INTERVAL))
+	{
+		// Make room for every neighbor
+		if (total > gTable.Size)
+		{
+			Row* rows = (Row*) realloc (gTable.Rows, total * sizeof (Row));
+			if (rows != NULL)
+			{
+				gTable.Rows = rows;
+				gTable.Size = total;
+			}
+		}
+
+		gTable.Count = 0;
+		for (k = 0; k < count; ++k)
+		for (i = 0; i < views[k].Count; ++i)
+		for (j = 0; j < (int) views[k].Shards[i]->Count &&
+			gTable.Count < gTable.Size; ++j)
+		{
+			Row* row = &gTable.Rows[gTable.Count];
+			row->State = &states[k];
+			row->Shard = i;
+			row->Index = j;
+			FillRow (row, &views[k].Shards[i]->Entries[j]);
+
+			if (gTable.Filter[0] == 0 || FilterRow (row))
+				++gTable.Count;
+		}
+
+		qsort (gTable.Rows, gTable.Count, sizeof (Row), CompareRows);
+		gTable.Layout = layout;
+		gTable.Sorted = time;
+		gTable.Total = total;
+		gTable.Stale = 0;
+	}
+
+	// Keep the scroll position within the rows
+	if (gTable.Top > (int) gTable.Count - lines)
+		gTable.Top = (int) gTable.Count - lines;
+	if (gTable.Top < 0)
+		gTable.Top = 0;
+
+	// Refresh the rows on the screen
+	for (i = gTable.Top; i < gTable.Top + lines && i < (int) gTable.Count; ++i)
+	{
+		Row* row = &gTable.Rows[i];
+		FillRow (row, &views[row->State - states].
+			Shards[row->Shard]->Entries[row->Index]);
+	}
+
+	gTable.Version = version;
+
+	for (k = 0; k < count; ++k)
+		NDP_ReleaseView (&views[k]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Draws a table line if its text has changed. </summary>
+
+static void DrawLine (int line, int y, const char* text)
+{
+	if (line >= MAX_LINES || strcmp (gTable.Lines[line], text) == 0)
+		return;
+
+	snprintf (gTable.Lines[line], LINE_LEN, "%s", text);
+	mvprintw (y, gX-35, "%-*s", LINE_LEN - 2, text);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Formats a duration in nanoseconds with a short unit. </summary>
+
+static void FormatTime (char* result, unsigned long long ns)
+{
+	if (ns < 1000ULL)       sprintf (result, "%4llu ns", ns); else
+	if (ns < 1000000ULL)    sprintf (result, "%4llu us", ns / 1000ULL); else
+	if (ns < 1000000000ULL) sprintf (result, "%4llu ms", ns / 1000000ULL); else
+							sprintf (result, "%4llu s ", ns / 1000000000ULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Draws the visible rows starting at the given line. </summary>
+/// <remarks> Only rows on the screen are formatted and only lines
+///           whose text has changed are written to the screen. </remarks>
+
+static void DrawRows (int y, int lines)
+{
+	unsigned long long time = NDP_Time();
+	char text[LINE_LEN + 32];
+	char interval[16], jitter[16];
+	int i;
+
+	for (i = 0; i < lines; ++i)
+	{
+		unsigned int index = gTable.Top + i;
+		if (index >= gTable.Count)
+			{ DrawLine (i, y + i, ""); continue; }
+
+		const Row* row = &gTable.Rows[index];
+		const char* addr = NDP_AddrString (&row->Addr);
+
+		if (gTable.Links)
+		{
+			FormatTime (interval, row->Link.Interval * 1000ULL);
+			FormatTime (jitter,   row->Link.Jitter   * 1000ULL);
+
+			// Loss is unknown without sequence numbers
+			if (row->Link.Extended)
+				 snprintf (text, sizeof (text), " %-9s | %-17s |  %4u  | %5.1f %% | %8s | %7s",
+					row->State->Interface, addr, row->Link.Received,
+					LinkLoss (&row->Link), interval, jitter);
+			else snprintf (text, sizeof (text), " %-9s | %-17s |  %4u  |     -   | %8s | %7s",
+					row->State->Interface, addr, row->Link.Received, interval, jitter);
+		}
+
+		else snprintf (text, sizeof (text), " %-9s | %-17s |    %7.1f s    |    %7.1f s",
+			row->State->Interface, addr, (time - row->Seen) * 1e-3,
+			((long long) (row->Expiry - time)) * 1e-3);
+
+		DrawLine (i, y + i, text);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Draws the statistics of every interface instead of the table. </summary>
+
+static void DrawStats (NDP_State* states, int count, int y, int lines)
+{
+	char text[LINE_LEN + 32];
+	char a[16], b[16], c[16];
+	NDP_Stats stats, shard;
+	int i, line = 0;
+
+	// Combine every interface
+	memset (&stats, 0, sizeof (stats));
+	for (i = 0; i < count; ++i)
+	{
+		NDP_GetStats (&states[i], &shard);
+		NDP_AddStats (&stats, &shard);
+	}
+
+	#define PRINT(...) if (line < lines) { snprintf (text, \
+		sizeof (text), __VA_ARGS__); DrawLine (line, y + line, text); ++line; }
+
+	PRINT (" FRAMES RECEIVED  %12llu    FRAMES FILTERED  %12llu", stats.FramesReceived,  stats.FramesFiltered);
+	PRINT (" BEACONS ACCEPTED %12llu    TABLE FULL DROPS %12llu", stats.BeaconsAccepted, stats.TableDrops    );
+	PRINT (" INSERTS          %12llu    EXPIRIES         %12llu", stats.Inserts,         stats.Expiries      );
+	PRINT (" BEACONS SENT     %12llu    SEND ERRORS      %12llu", stats.BeaconsSent,     stats.SendErrors    );
+	PRINT (" SUPPRESSED       %12llu", stats.BeaconsSuppressed);
+	PRINT ("%s", "");
+
+	FormatTime (a, NDP_Percentile (stats.LockHold, 0.50));
+	FormatTime (b, NDP_Percentile (stats.LockHold, 0.99));
+	FormatTime (c, NDP_Percentile (stats.LockHold, 1.00));
+	PRINT (" LOCK HOLD     P50 < %s   P99 < %s   MAX < %s", a, b, c);
+
+	FormatTime (a, NDP_Percentile (stats.Latency, 0.50));
+	FormatTime (b, NDP_Percentile (stats.Latency, 0.99));
+	FormatTime (c, NDP_Percentile (stats.Latency, 1.00));
+	PRINT (" PROCESSING    P50 < %s   P99 < %s   MAX < %s", a, b, c);
+
+	FormatTime (a, NDP_Percentile (stats.WireLatency, 0.50));
+	FormatTime (b, NDP_Percentile (stats.WireLatency, 0.99));
+	FormatTime (c, NDP_Percentile (stats.WireLatency, 1.00));
+	PRINT (" WIRE TO TABLE P50 < %s   P99 < %s   MAX < %s", a, b, c);
+	PRINT ("%s", "");
+
+	PRINT (" %-11s | %16s | %16s | %16s", "BUCKET", "LOCK HOLD", "PROCESSING", "WIRE TO TABLE");
+	PRINT ("----------------------------------------------------------------------");
+
+	// Print the histograms side by side
+	for (i = 0; i < NDP_HISTOGRAM_LEN; ++i)
+	{
+		if (stats.LockHold[i] == 0 && stats.Latency[i] == 0 && stats.WireLatency[i] == 0)
+			continue;
+
+		FormatTime (a, 1ULL << (i + 1));
+		PRINT (" < %-9s | %16llu | %16llu | %16llu", a,
+			stats.LockHold[i], stats.Latency[i], stats.WireLatency[i]);
+	}
+
+	#undef PRINT
+
+	// Clear the remaining lines
+	for (; line < lines; ++line)
+		DrawLine (line, y + line, "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Forgets what is on the screen so every line is redrawn. </summary>
+
+static void InvalidateRows (void)
+{
+	int i;
+	for (i = 0; i < MAX_LINES; ++i)
+		gTable.Lines[i][0] = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Prompts for a new filter at the bottom of the screen. </summary>
+
+static void PromptFilter (int y)
+{
+	mvprintw (y, gX-35, "%-*s", LINE_LEN - 2, " FILTER: ");
+	move (y, gX-26);
+
+	timeout (-1); curs_set (1);
+	echo(); getnstr (gTable.Filter, sizeof (gTable.Filter) - 1); noecho();
+	timeout (100); curs_set (0);
+
+	gTable.Stale = 1;
+	gTable.Top = 0;
+}
+
+
+
 //----------------------------------------------------------------------------//
 // Menu                                                                       //
 //----------------------------------------------------------------------------//
@@ -109,48 +513,87 @@ static void PrintIcon (int x, int y, bool selected)
 
 static void StartNDP (void)
 {
-	NDP_State state;
-
-	// Get the name of the interface to use
-	mvprintw (gY+2, gX-25, "Enter the name of the wireless interface you would ");
-	mvprintw (gY+3, gX-25, "like to use or leave blank to use the default (ra0)");
-
-	refresh(); move (gY+5, gX-4);
-	echo(); getnstr (state.Interface, 8); noecho();
+	NDP_State states[MAX_INTERFACES];
+	NDP_State* active[MAX_INTERFACES];
+	NDP_Engine engine;
+	char names[80];
+	int i, j, k, count = 0;
+
+	// Get the names of the interfaces to use
+	mvprintw (gY+2, gX-25, "Enter the names of the wireless interfaces to use  ");
+	mvprintw (gY+3, gX-25, "separated by spaces or leave blank for the default ");
+	mvprintw (gY+4, gX-25, "(ra0)                                              ");
+
+	refresh(); move (gY+6, gX-20);
+	echo(); getnstr (names, 40); noecho();
+
+	// Split the specified interface names
+	char* name = strtok (names, " ,");
+	for (; name != NULL && count < MAX_INTERFACES; ++count)
+	{
+		NDP_Init (&states[count]);
+		snprintf (states[count].Interface, NDP_IFNAME_LEN, "%s", name);
+		name = strtok (NULL, " ,");
+	}
 
-	// Copy the specified interface name
-	if (state.Interface[0] == '\0')
+	if (count == 0)
 	{
 		// Use the default interface name
-		state.Interface[0] =  'r';
-		state.Interface[1] =  'a';
-		state.Interface[2] =  '0';
-		state.Interface[3] = '\0';
+		NDP_Init (&states[0]);
+		strcpy (states[0].Interface, "ra0");
+		count = 1;
 	}
 
 	// Start the Neighbor Discovery Protocol
-	NDP_Create (&state);
-	NDP_Start  (&state);
+	NDP_State* failed = NULL;
+	for (k = 0; k < count; ++k)
+	{
+		active[k] = &states[k];
+		states[k].Shards = gShards;
+		states[k].Timestamps = gTimestamps;
+		NDP_Create (&states[k]);
+
+		if (states[k].Error != NDP_ERROR_NONE && failed == NULL)
+			failed = &states[k];
+	}
+
+	// Serve every interface from a single engine
+	if (failed == NULL)
+	{
+		NDP_EngineStart (&engine, active, count);
+		if (engine.Error != NDP_ERROR_NONE)
+		{
+			states[0].Error = engine.Error;
+			failed = &states[0];
+		}
+	}
 
 	Clear();
-	timeout (0);
+	timeout (100);
 
-	int i, j;
-	char pressed = 0;
-	NDP_Neighbor* n;
 	char result[80];
-	long slp = 0;
+	char redraw = 1;
+	char panel = 0;
+	int key;
+
+	// Start from a fresh table
+	gTable.Top = 0;
+	gTable.Stale = 1;
+	gTable.Filter[0] = 0;
+
+	// Measure the achieved stress rate
+	struct timespec now, last;
+	clock_gettime (CLOCK_MONOTONIC, &last);
+	unsigned long long sent = 0;
+	double rate = 0;
 
 	while (1)
 	{
 		// Check for errors
-		if (state.Error == NDP_ERROR_NONE)
-			mvprintw (2, gX-14, "Press Q to Return to the Menu");
-
-		else
+		if (failed != NULL)
 		{
 			// Convert error index into a string
-			const char* error = NDP_ErrorString (&state);
+			const char* error = NDP_ErrorString (failed);
 
 			// Center the error message
 			for (i = 0; error[i] != 0; ++i);
@@ -162,56 +605,154 @@ static void StartNDP (void)
 			break;
 		}
 
-		// Check for terminate key
-		pressed = getch() | 32;
-		if (pressed == 'q')
-			break;
+		// Table rows fill the screen below the header
+		int top   = 8 + count;
+		int lines = LINES - top - 1;
+		if (lines > MAX_LINES) lines = MAX_LINES;
+		if (lines < 0) lines = 0;
 
-		if (pressed == 'f')
-			state.Stress = state.Stress == 0 ? 1 : 0;
+		// Wait up to 100 ms for a key
+		key = getch();
+		if (key == 'q' || key == 'Q')
+			break;
 
-		if (state.Stress == 1)
+		switch (key)
 		{
-			attron (COLOR_PAIR (WARNING));
-			mvprintw (3, gX-9, "--STRESS TESTING--");
-			attron (COLOR_PAIR (NORMAL ));
+			case 'f': case 'F':
+			{
+				char stress = states[0].Stress == 0;
+				for (k = 0; k < count; ++k)
+					NDP_SetStress (&states[k], stress);
+				break;
+			}
+
+			case 's': case 'S':
+				gTable.Sort = (gTable.Sort + 1) % SORT_COUNT;
+				gTable.Stale = 1;
+				break;
+
+			case 'r': case 'R':
+				gTable.Reverse = !gTable.Reverse;
+				gTable.Stale = 1;
+				break;
+
+			case '/':
+				PromptFilter (LINES - 1);
+				break;
+
+			case 't': case 'T':
+				panel = !panel;
+				break;
+
+			case 'l': case 'L':
+				gTable.Links = !gTable.Links;
+				redraw = 1;
+				break;
+
+			case KEY_UP   : gTable.Top -= 1;                 break;
+			case KEY_DOWN : gTable.Top += 1;                 break;
+			case KEY_PPAGE: gTable.Top -= lines;             break;
+			case KEY_NPAGE: gTable.Top += lines;             break;
+			case KEY_HOME : gTable.Top  = 0;                 break;
+			case KEY_END  : gTable.Top  = gTable.Count;      break;
+			case KEY_RESIZE: redraw = 1;                     break;
 		}
 
-		// Sleep for 100 ms
-		refresh();
-		usleep (slp);
-		slp = 100000;
-		Clear();
+		// Update the rate every second
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec  - last.tv_sec ) +
+						 (now.tv_nsec - last.tv_nsec) * 1e-9;
+
+		if (elapsed >= 1)
+		{
+			unsigned long long total = 0;
+			for (k = 0; k < count; ++k)
+				total += NDP_StressSent (&states[k]);
 
-		// Print interface information
-		sprintf (result, "INTERFACE: %-8s INDEX: %-2d MTU: %-5d ADDRESS: %s",
-				state.Interface, state.IfIndex, state.MTU, NDP_AddrString (&state.Addr));
+			rate = (total - sent) / elapsed;
+			sent = total; last = now;
+		}
+
+		// Print the static parts only when needed
+		if (redraw)
+		{
+			Clear();
+			InvalidateRows();
+			attron (COLOR_PAIR (NORMAL));
+			mvprintw (2, gX-14, "Press Q to Return to the Menu");
 
-		// Center the interface message
-		for (i = 0; result[i] != 0; ++i);
-		i = (int) i * 0.5;
+			// Print interface information
+			for (k = 0; k < count; ++k)
+			{
+				sprintf (result, "INTERFACE: %-8s INDEX: %-2d MTU: %-5d ADDRESS: %s",
+						states[k].Interface, states[k].IfIndex, states[k].MTU,
+						NDP_AddrString (&states[k].Addr));
 
-		// Print the interface message
-		mvprintw (5, gX-i, result);
+				// Center the interface message
+				for (i = 0; result[i] != 0; ++i);
+				i = (int) i * 0.5;
 
-		// Print NDP table
-		mvprintw (7, gX-30, "      ADDRESS      |      ARRIVED      |      RECORDED      ");
-		mvprintw (8, gX-30, "------------------------------------------------------------");
+				// Print the interface message
+				mvprintw (5 + k, gX-i, result);
+			}
 
-		NDP_Lock (&state);
+			// Print NDP table header
+			j = 6 + count;
+			mvprintw (j++, gX-35, gTable.Links ?
+				" INTERFACE |      ADDRESS      |   RX   |  LOSS   | INTERVAL | JITTER " :
+				" INTERFACE |      ADDRESS      |    LAST SEEN    |    EXPIRES IN   ");
+			mvprintw (j,   gX-35, "----------------------------------------------------------------------");
+			redraw = 0;
+		}
 
-		for (i = 0, j = 8; i < NDP_TABLE_LEN; ++i)
+		move (3, 0); clrtoeol();
+		if (states[0].Stress == 1)
 		{
-			n = state.Table[i];
-			if (n != NULL) mvprintw (++j, gX-30, " %-17s |       %-11s |     %6d",
-				NDP_AddrString (&n->Addr), n->Arrived == 0 ? "FALSE" : "TRUE", (int) n->Recorded);
+			attron (COLOR_PAIR (WARNING));
+			sprintf (result, "--STRESS TESTING-- %.0f BEACONS/S", rate);
+
+			// Center the stress message
+			for (i = 0; result[i] != 0; ++i);
+			i = (int) i * 0.5;
+
+			mvprintw (3, gX-i, result);
+			attron (COLOR_PAIR (NORMAL ));
 		}
 
-		NDP_Unlock (&state);
+		// Print only the visible rows of the table
+		BuildRows (states, count, lines);
+		if (panel)
+			 DrawStats (states, count, top, lines);
+		else DrawRows  (top, lines);
+
+		// Print the neighbor counts and controls
+		int bottom = gTable.Top + lines;
+		if (bottom > (int) gTable.Count)
+			bottom = gTable.Count;
+
+		move (LINES - 1, 0); clrtoeol();
+		attron (COLOR_PAIR (INVERTED));
+		mvprintw (LINES - 1, 0, " NEIGHBORS: %u  SHOWN: %u  ROWS: %d-%d  SORT: %s%s  "
+			"FILTER: %s  [S]ORT [R]EVERSE [/]FILTER [T]STATS [L]INKS ", gTable.Total, gTable.Count,
+			gTable.Count ? gTable.Top + 1 : 0, bottom,
+			sSortNames[gTable.Sort], gTable.Reverse ? " (REVERSED)" : "",
+			gTable.Filter[0] ? gTable.Filter : "NONE");
+		attron (COLOR_PAIR (NORMAL));
+
+		refresh();
 	}
 
-	NDP_Stop    (&state);
-	NDP_Destroy (&state);
+	if (failed == NULL)
+		NDP_EngineStop (&engine);
+
+	for (k = 0; k < count; ++k)
+		NDP_Destroy (&states[k]);
+
+	// Release the table rows
+	free (gTable.Rows);
+	gTable.Rows = NULL;
+	gTable.Size = 0;
+	gTable.Count = 0;
 
 	attron (COLOR_PAIR (NORMAL));
 	mvprintw (3, gX-12, "Press Any Key to Continue");
@@ -296,9 +837,34 @@ static void StartMenu (void)
 /// <summary> Main execution point for this application. </summary>
 /// <returns> Zero for success, error code for failure. </returns>
 
-int main (void)
+int main (int argc, char** argv)
 {
-	srand (time (NULL));	// Seed randomizer
+	static const struct option options[] =
+	{
+		{ "shards",     required_argument, NULL, 'k' },
+		{ "timestamps", no_argument,       NULL, 'T' },
+		{ "help",       no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int option;
+
+	// Parse the command line
+	while ((option = getopt_long (argc, argv, "k:Th", options, NULL)) != -1)
+	{
+		switch (option)
+		{
+			case 'k': gShards     = atoi (optarg); break;
+			case 'T': gTimestamps = 1;             break;
+
+			default:
+				fprintf (stderr,
+					"Usage: %s [options]\n"
+					"  -k, --shards N         Receive shards per interface (default 1)\n"
+					"  -T, --timestamps       Measure the wire to table latency\n", argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
 
 	initscr();				// Init nCurses
 	start_color();			// Enable color
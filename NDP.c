@@ -15,6 +15,7 @@
 // Prefaces                                                                   //
 //----------------------------------------------------------------------------//
 
+#define _GNU_SOURCE
 #include "NDP.h"
 
 #include <stdio.h>
@@ -23,12 +24,31 @@
 #include <stdlib.h>
 
 #include <netinet/in.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 #include <net/ethernet.h>
 
 #include <linux/if.h>
+#include <linux/filter.h>
 #include <sys/ioctl.h>
 
+#include <time.h>
+#include <sched.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+	#include <immintrin.h>
+#endif
+
 
 
 //----------------------------------------------------------------------------//
@@ -36,382 +56,4167 @@
 //----------------------------------------------------------------------------//
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Maximum last recorded value allowed. </summary>
-/// <remarks> This value is inclusive [-1, max]. </remarks>
+/// <summary> Number of keys compared at once while probing. </summary>
+/// <remarks> The first keys are mirrored past the end of the table so a
+///           group starting near the end never has to wrap around. </remarks>
+
+#define TABLE_GROUP_LEN 4
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Layout of the memory-mapped receive ring. </summary>
+/// <remarks> Blocks are handed over once full or after the timeout (ms),
+///           which is the shortest possible in the low latency profile. </remarks>
+
+#define RING_BLOCK_SIZE	(1 << 16)
+#define RING_BLOCK_NR	64
+#define RING_TIMEOUT	2
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Largest number of frames received in a single batch. </summary>
 
-#define NDP_MAX_RECORD 6
+#define BATCH_MAX 1024
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Non-reserved IP type for the beacon. </summary>
+/// <summary> Room for the kernel receive timestamp of a message. </summary>
 
-#define IP_TYPE 0x3900
+#define CONTROL_LEN CMSG_SPACE (sizeof (struct timespec))
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Number of spoofed beacons handed to sendmmsg at once. </summary>
+
+#define FLOOD_BATCH 64
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Maximum number of stress testing sender threads. </summary>
+
+#define FLOOD_THREADS_MAX 64
 
 ////////////////////////////////////////////////////////////////////////////////
 /// <summary> Represents a single beacon that's sent. </summary>
+/// <remarks> The payload is laid out as described by NDP_BEACON_TYPE.
+///           Legacy beacons have no payload, padding reads as version
+///           zero so they are told apart without knowing the length. </remarks>
 
 typedef struct
 {
 	NDP_Addr TargetAddr;	// Target address
 	NDP_Addr SourceAddr;	// Source address
-	unsigned short Type;	// IP Type (0x3900)
+	unsigned short Type;	// IP Type (NDP_BEACON_TYPE)
+
+	// Version and fields of extended beacons
+	unsigned char Payload[NDP_BEACON_MAX_LEN - NDP_BEACON_HEADER_LEN];
 
 } Beacon;
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the buffers used to receive a batch. </summary>
+
+typedef struct
+{
+	struct mmsghdr* Headers;	// Message headers
+	struct iovec* Vectors;		// Message buffers
+	Beacon* Beacons;			// Received beacons
+	char* Controls;				// Kernel receive timestamps
+
+} Batch;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single stress testing sender thread. </summary>
+
+typedef struct
+{
+	NDP_State* State;		// Owning state
+	pthread_t Thread;		// Thread ID
+	int SocketID;			// Send only socket
+	unsigned long long Seed;	// Random state
+	double Rate;			// Beacons per second (0 = unlimited)
+	volatile unsigned long long Sent;	// Beacons sent
+	unsigned long long Errors;			// Failed sends
+
+} __attribute__ ((aligned (64))) Flooder;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Magic numbers and link type of pcap files. </summary>
+
+#define PCAP_MAGIC_US	0xA1B2C3D4	// Microsecond timestamps
+#define PCAP_MAGIC_NS	0xA1B23C4D	// Nanosecond timestamps
+#define PCAP_ETHERNET	1
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the global header of a pcap file. </summary>
+
+typedef struct
+{
+	uint32_t Magic;				// Byte order and timestamp unit
+	uint16_t Major;				// Format version
+	uint16_t Minor;
+	int32_t  Zone;				// Always zero
+	uint32_t Accuracy;			// Always zero
+	uint32_t SnapLen;			// Maximum captured length
+	uint32_t LinkType;			// Link layer header type
+
+} PcapHeader;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the header of a single pcap record. </summary>
+
+typedef struct
+{
+	uint32_t Seconds;			// Timestamp seconds
+	uint32_t Fraction;			// Timestamp fraction
+	uint32_t Length;			// Captured length
+	uint32_t Original;			// Length on the wire
+
+} PcapRecord;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Magic number and version of persisted tables. </summary>
+/// <remarks> The version changes whenever the layout of the file does. </remarks>
+
+#define PERSIST_MAGIC	0x5450444E	// "NDPT"
+#define PERSIST_VERSION	1
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the header of a persisted table. </summary>
+/// <remarks> Writing is odd while a save is in progress, files left
+///           in that state by a crash are discarded. </remarks>
+
+typedef struct
+{
+	uint32_t Magic;				// Identifies the file
+	uint32_t Version;			// Layout of the file
+	uint32_t RecordSize;		// Size of every record
+	uint32_t Size;				// Records the file has room for
+	uint32_t Count;				// Records in use
+	volatile uint32_t Writing;	// Number of saves started and finished
+	uint64_t Saved;				// Wall clock time of the save (ms)
+
+} PersistHeader;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single neighbor of a persisted table. </summary>
+
+typedef struct
+{
+	NDP_Addr Addr;				// Neighbor address
+	uint8_t Reserved[2];		// Always zero
+	uint64_t Seen;				// Wall clock time of the last beacon (ms)
+
+} PersistRecord;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a table file mapped into memory. </summary>
+
+typedef struct
+{
+	int File;					// File descriptor
+	PersistHeader* Header;		// Mapped contents
+	size_t Length;				// Length of the mapping
+
+} PersistFile;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the shared memory segment of a state. </summary>
+
+typedef struct
+{
+	int File;					// Segment descriptor
+	NDP_Export* Segment;		// Mapped contents
+	size_t Length;				// Length of the mapping
+	char Name[NAME_MAX];		// Name given to shm_open
+
+} ExportSegment;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single cell of the event ring. </summary>
+
+typedef struct
+{
+	volatile unsigned long long Sequence;	// Lap the cell belongs to
+	NDP_Event Event;						// Stored event
+
+} EventCell;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a bounded ring of events with many producers
+///           and a single consumer. </summary>
+
+typedef struct
+{
+	unsigned long long Mask;	// Number of cells minus one
+
+	volatile unsigned long long Head __attribute__ ((aligned (64)));
+	volatile unsigned long long Drops;		// Events lost to overflow
+
+	unsigned long long Tail __attribute__ ((aligned (64)));
+	EventCell Cells[];			// Ring cells
+
+} EventRing;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single entry of the neighbor pool. </summary>
+
+typedef union PoolItem
+{
+	NDP_Neighbor Neighbor;	// Entry in use
+	union PoolItem* Next;	// Next free entry
+
+} PoolItem;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a contiguous block of pool entries. </summary>
+
+typedef struct PoolSlab
+{
+	struct PoolSlab* Next;	// Next allocated slab
+	PoolItem Items[];		// Slab entries
+
+} PoolSlab;
+
 
 
 //----------------------------------------------------------------------------//
-// NDP                                                                        //
+// Pool                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds a slab of the specified number of entries. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int PoolGrow (NDP_Pool* pool, unsigned int count)
+{
+	unsigned int i;
+
+	PoolSlab* slab = (PoolSlab*) malloc
+		(sizeof (PoolSlab) + count * sizeof (PoolItem));
+
+	if (slab == NULL)
+		return -1;
+
+	// Thread the new entries onto the free list
+	for (i = 0; i < count; ++i)
+		slab->Items[i].Next = i + 1 < count ?
+			&slab->Items[i + 1] : (PoolItem*) pool->Free;
+
+	pool->Free = slab->Items;
+	slab->Next = (PoolSlab*) pool->Slabs;
+	pool->Slabs = slab;
+	pool->Size += count;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Takes an entry out of the pool. </summary>
+/// <remarks> The pool doubles in size when it runs out of entries. </remarks>
+
+static NDP_Neighbor* PoolAcquire (NDP_Pool* pool)
+{
+	if (pool->Free == NULL && PoolGrow
+		(pool, pool->Size > 0 ? pool->Size : NDP_TABLE_LEN) < 0)
+		return NULL;
+
+	PoolItem* item = (PoolItem*) pool->Free;
+	pool->Free = item->Next;
+	return &item->Neighbor;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns an entry back to the pool. </summary>
+
+static void PoolRelease (NDP_Pool* pool, NDP_Neighbor* neighbor)
+{
+	PoolItem* item = (PoolItem*) neighbor;
+	item->Next = (PoolItem*) pool->Free;
+	pool->Free = item;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases every slab allocated by the pool. </summary>
+
+static void PoolDestroy (NDP_Pool* pool)
+{
+	PoolSlab* slab = (PoolSlab*) pool->Slabs;
+	while (slab != NULL)
+	{
+		PoolSlab* next = slab->Next;
+		free (slab);
+		slab = next;
+	}
+
+	pool->Slabs = NULL;
+	pool->Free  = NULL;
+	pool->Size  = 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Wheel                                                                      //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds a neighbor to the wheel slot of its expiry tick. </summary>
+/// <remarks> Ticks that were already processed go into the next one. </remarks>
+
+static void WheelLink (NDP_Wheel* wheel, NDP_Neighbor* neighbor)
+{
+	const unsigned long long mask = NDP_WHEEL_LEN - 1;
+	unsigned long long expiry = neighbor->Expiry;
+	NDP_Neighbor** slot;
+	int level;
+
+	if (expiry <= wheel->Tick)
+		expiry = wheel->Tick + 1;
+
+	// Find the level whose span covers the expiry
+	unsigned long long delta = expiry - wheel->Tick;
+	for (level = 0; level < NDP_WHEEL_LEVELS - 1; ++level)
+	{
+		if (delta < NDP_WHEEL_LEN)
+			break;
+
+		delta  >>= NDP_WHEEL_BITS;
+		expiry >>= NDP_WHEEL_BITS;
+	}
+
+	// Clamp far deadlines to the last slot of the top level
+	if (delta >= NDP_WHEEL_LEN)
+		expiry = (wheel->Tick >> (NDP_WHEEL_BITS * level)) + mask;
+
+	slot = &wheel->Slots[level][expiry & mask];
+
+	neighbor->Next = *slot;
+	neighbor->Prev = slot;
+	if (*slot != NULL)
+		(*slot)->Prev = &neighbor->Next;
+
+	*slot = neighbor;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Removes a neighbor from its wheel slot. </summary>
+
+static void WheelUnlink (NDP_Neighbor* neighbor)
+{
+	*neighbor->Prev = neighbor->Next;
+	if (neighbor->Next != NULL)
+		neighbor->Next->Prev = neighbor->Prev;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Moves the neighbors of a higher level slot down a level. </summary>
+/// <remarks> Called when the current tick enters the span of the slot. </remarks>
+
+static void WheelCascade (NDP_Wheel* wheel, int level)
+{
+	const unsigned long long mask = NDP_WHEEL_LEN - 1;
+
+	NDP_Neighbor** slot = &wheel->Slots[level]
+		[(wheel->Tick >> (NDP_WHEEL_BITS * level)) & mask];
+
+	NDP_Neighbor* neighbor = *slot;
+	*slot = NULL;
+
+	while (neighbor != NULL)
+	{
+		NDP_Neighbor* next = neighbor->Next;
+
+		// Neighbors due now expire with the current tick
+		if (neighbor->Expiry <= wheel->Tick)
+		{
+			NDP_Neighbor** now = &wheel->Slots[0][wheel->Tick & mask];
+
+			neighbor->Next = *now;
+			neighbor->Prev = now;
+			if (*now != NULL)
+				(*now)->Prev = &neighbor->Next;
+
+			*now = neighbor;
+		}
+
+		else WheelLink (wheel, neighbor);
+		neighbor = next;
+	}
+}
+
+
+
 //----------------------------------------------------------------------------//
+// Table                                                                      //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Packs an address into a 64-bit key. </summary>
+/// <remarks> A bit above the address marks the key as used, so even the
+///           all-zero address is told apart from an empty slot. </remarks>
+
+static inline unsigned long long PackAddr (const NDP_Addr* address)
+{
+	unsigned long long key = 0;
+	memcpy (&key, address->Data, NDP_ADDR_LEN);
+	return key | (1ULL << 48);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Recovers the address packed into a key. </summary>
+
+static inline void UnpackKey (unsigned long long key, NDP_Addr* address)
+{
+	memcpy (address->Data, &key, NDP_ADDR_LEN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the table slot a key hashes to. </summary>
+/// <remarks> Fibonacci hashing of the packed address. </remarks>
+
+static unsigned int HashKey (const NDP_Table* table, unsigned long long key)
+{
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (unsigned int) (key >> 32) & (table->Capacity - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Stores a key, mirroring the first keys past the end. </summary>
+
+static inline void SetKey (NDP_Table* table, unsigned int i, unsigned long long key)
+{
+	table->Keys[i] = key;
+	if (i < TABLE_GROUP_LEN - 1)
+		table->Keys[table->Capacity + i] = key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Probes for a key one slot at a time. </summary>
+/// <remarks> Returns the empty slot where it belongs if not found. </remarks>
+
+static unsigned int ProbeScalar (const NDP_Table* table, unsigned long long key)
+{
+	unsigned int mask = table->Capacity - 1;
+	unsigned int i = HashKey (table, key);
+
+	// Linear probe until a match or an empty slot
+	while (table->Keys[i] != 0 && table->Keys[i] != key)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+#if defined (__x86_64__) || defined (__i386__)
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns a mask of two keys that match or are empty. </summary>
+/// <remarks> SSE2 lacks a 64-bit compare, so both 32-bit halves of a
+///           key are compared and combined. </remarks>
+
+__attribute__ ((target ("sse2")))
+static inline unsigned int MatchSSE2 (const unsigned long long*
+	keys, __m128i needle)
+{
+	__m128i k = _mm_loadu_si128 ((const __m128i*) keys);
+	__m128i equal = _mm_cmpeq_epi32 (k, needle);
+	__m128i empty = _mm_cmpeq_epi32 (k, _mm_setzero_si128());
+
+	equal = _mm_and_si128 (equal, _mm_shuffle_epi32 (equal, _MM_SHUFFLE (2, 3, 0, 1)));
+	empty = _mm_and_si128 (empty, _mm_shuffle_epi32 (empty, _MM_SHUFFLE (2, 3, 0, 1)));
+	return (unsigned int) _mm_movemask_pd (_mm_castsi128_pd (_mm_or_si128 (equal, empty)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Probes for a key a group at a time with SSE2. </summary>
+
+__attribute__ ((target ("sse2")))
+static unsigned int ProbeSSE2 (const NDP_Table* table, unsigned long long key)
+{
+	unsigned int mask = table->Capacity - 1;
+	unsigned int i = HashKey (table, key);
+	__m128i needle = _mm_set1_epi64x ((long long) key);
+
+	while (1)
+	{
+		unsigned int found = MatchSSE2 (&table->Keys[i    ], needle)
+						   | MatchSSE2 (&table->Keys[i + 2], needle) << 2;
+
+		// The first match or empty slot ends the probe
+		if (found != 0)
+			return (i + __builtin_ctz (found)) & mask;
+
+		i = (i + TABLE_GROUP_LEN) & mask;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Probes for a key a group at a time with AVX2. </summary>
+
+__attribute__ ((target ("avx2")))
+static unsigned int ProbeAVX2 (const NDP_Table* table, unsigned long long key)
+{
+	unsigned int mask = table->Capacity - 1;
+	unsigned int i = HashKey (table, key);
+	__m256i needle = _mm256_set1_epi64x ((long long) key);
+
+	while (1)
+	{
+		__m256i k = _mm256_loadu_si256 ((const __m256i*) &table->Keys[i]);
+		__m256i hit = _mm256_or_si256 (_mm256_cmpeq_epi64 (k, needle),
+						_mm256_cmpeq_epi64 (k, _mm256_setzero_si256()));
+
+		// The first match or empty slot ends the probe
+		unsigned int found = (unsigned int)
+			_mm256_movemask_pd (_mm256_castsi256_pd (hit));
+		if (found != 0)
+			return (i + __builtin_ctz (found)) & mask;
+
+		i = (i + TABLE_GROUP_LEN) & mask;
+	}
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Probe used by the table, chosen for the processor. </summary>
+
+static unsigned int (*sProbe) (const NDP_Table*, unsigned long long) = NULL;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Makes sure the probe is chosen only once. </summary>
+
+static pthread_once_t sProbeOnce = PTHREAD_ONCE_INIT;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Chooses the widest probe the processor supports. </summary>
+
+static void SelectProbe (void)
+{
+	sProbe = ProbeScalar;
+
+#if defined (__x86_64__) || defined (__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports ("sse2")) sProbe = ProbeSSE2;
+	if (__builtin_cpu_supports ("avx2")) sProbe = ProbeAVX2;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases the slots of a table and the arrays beside them. </summary>
+
+static void TableFree (NDP_Table* table)
+{
+	free (table->Keys);
+	free (table->Seen);
+	free (table->Expiry);
+	free (table->Tracks);
+	free (table->Slots);
+
+	table->Keys     = NULL;
+	table->Seen     = NULL;
+	table->Expiry   = NULL;
+	table->Tracks   = NULL;
+	table->Slots    = NULL;
+	table->Capacity = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Allocates an empty table sized for the specified count. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int TableAlloc (NDP_Table* table, unsigned int count)
+{
+	// Keep the load factor under 3/4
+	unsigned int capacity = 8;
+	while (capacity - (capacity >> 2) < count)
+		capacity <<= 1;
+
+	NDP_Neighbor** slots = (NDP_Neighbor**)
+		calloc (capacity, sizeof (NDP_Neighbor*));
+
+	// Leave room for the mirrored keys
+	unsigned long long* keys = (unsigned long long*) calloc
+		(capacity + TABLE_GROUP_LEN - 1, sizeof (unsigned long long));
+
+	unsigned long long* seen   = (unsigned long long*)
+		malloc (capacity * sizeof (unsigned long long));
+	unsigned long long* expiry = (unsigned long long*)
+		malloc (capacity * sizeof (unsigned long long));
+	NDP_Track* tracks = (NDP_Track*)
+		malloc (capacity * sizeof (NDP_Track));
+
+	table->Keys     = keys;
+	table->Seen     = seen;
+	table->Expiry   = expiry;
+	table->Tracks   = tracks;
+	table->Slots    = slots;
+	table->Capacity = capacity;
+	table->Count    = 0;
+
+	if (slots == NULL || keys == NULL || seen == NULL ||
+		expiry == NULL || tracks == NULL)
+		{ TableFree (table); return -1; }
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates a table and a pool sized for the specified count. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int TableCreate (NDP_Table* table, unsigned int count)
+{
+	memset (table, 0, sizeof (NDP_Table));
+
+	// States may be created on several threads
+	pthread_once (&sProbeOnce, SelectProbe);
+
+	if (TableAlloc (table, count) < 0)
+		return -1;
+
+	if (PoolGrow (&table->Pool, count) < 0)
+		{ TableFree (table); return -1; }
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the slot index of a key in the table. </summary>
+/// <remarks> Returns the empty slot where it belongs if not found. </remarks>
+
+static inline unsigned int TableProbe (const NDP_Table* table, unsigned long long key)
+{
+	return sProbe (table, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the slot index of an address in the table. </summary>
+/// <remarks> Returns the empty slot where it belongs if not found. </remarks>
+
+static inline unsigned int TableFind (const NDP_Table* table, const NDP_Addr* address)
+{
+	unsigned long long key = PackAddr (address);
+
+	unsigned int home = HashKey (table, key);
+
+	// Fetch the entry state while the keys are probed
+	__builtin_prefetch (&table->Seen  [home]);
+	__builtin_prefetch (&table->Tracks[home]);
+	return sProbe (table, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Doubles the capacity of the table and rehashes it. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int TableGrow (NDP_Table* table)
+{
+	NDP_Table grown;
+	unsigned int i, j;
+
+	if (TableAlloc (&grown, table->Capacity) < 0)
+		return -1;
+
+	// Reinsert every neighbor into the new slots
+	for (i = 0; i < table->Capacity; ++i)
+		if (table->Keys[i] != 0)
+		{
+			j = TableProbe (&grown, table->Keys[i]);
+			SetKey (&grown, j, table->Keys[i]);
+			grown.Seen  [j] = table->Seen  [i];
+			grown.Expiry[j] = table->Expiry[i];
+			grown.Tracks[j] = table->Tracks[i];
+			grown.Slots [j] = table->Slots [i];
+		}
+
+	TableFree (table);
+	table->Keys     = grown.Keys;
+	table->Seen     = grown.Seen;
+	table->Expiry   = grown.Expiry;
+	table->Tracks   = grown.Tracks;
+	table->Slots    = grown.Slots;
+	table->Capacity = grown.Capacity;
+	++table->Layout;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Removes the neighbor at the specified slot index. </summary>
+/// <remarks> Shifts the following probe run back to fill the hole. </remarks>
+
+static void TableRemove (NDP_Table* table, unsigned int hole)
+{
+	unsigned int mask = table->Capacity - 1;
+	unsigned int i = hole, home;
+
+	WheelUnlink (table->Slots[hole]);
+	table->Dirty = 1;
+	PoolRelease (&table->Pool, table->Slots[hole]);
+	table->Slots[hole] = NULL;
+	SetKey (table, hole, 0);
+	--table->Count;
+	++table->Layout;
+
+	while (1)
+	{
+		i = (i + 1) & mask;
+		if (table->Keys[i] == 0)
+			return;
+
+		// Move entries whose home is not between the hole and i
+		home = HashKey (table, table->Keys[i]);
+		if (((i - home) & mask) >= ((i - hole) & mask))
+		{
+			table->Seen  [hole] = table->Seen  [i];
+			table->Expiry[hole] = table->Expiry[i];
+			table->Tracks[hole] = table->Tracks[i];
+			table->Slots [hole] = table->Slots [i];
+			SetKey (table, hole, table->Keys[i]);
+			table->Slots[i] = NULL;
+			SetKey (table, i, 0);
+			hole = i;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Removes every neighbor from the table. </summary>
+
+static void TableClear (NDP_Table* table)
+{
+	unsigned int i;
+	for (i = 0; i < table->Capacity; ++i)
+		if (table->Slots[i] != NULL)
+		{
+			PoolRelease (&table->Pool, table->Slots[i]);
+			table->Slots[i] = NULL;
+			SetKey (table, i, 0);
+		}
+
+	table->Count = 0;
+	table->Dirty = 1;
+	++table->Layout;
+	memset (table->Wheel.Slots, 0, sizeof (table->Wheel.Slots));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases the table slots and the neighbor pool. </summary>
+
+static void TableDestroy (NDP_Table* table)
+{
+	TableFree (table);
+	table->Count = 0;
+
+	PoolDestroy (&table->Pool);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Events                                                                     //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Allocates the event ring of a state. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateEvents (NDP_State* state)
+{
+	// Round the ring up to a power of two
+	unsigned long long i, size = 1;
+	while (size < (unsigned int) state->EventSize)
+		size <<= 1;
+
+	EventRing* ring = (EventRing*) calloc
+		(1, sizeof (EventRing) + size * sizeof (EventCell));
+	if (ring == NULL)
+		return -1;
+
+	// Every cell starts out free for the first lap
+	for (i = 0; i < size; ++i)
+		ring->Cells[i].Sequence = i;
+
+	ring->Mask = size - 1;
+	state->Events = ring;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Pushes an event into the ring or counts it as dropped. </summary>
+/// <remarks> Producers claim cells by advancing the head, the cell
+///           sequence tells them whether the consumer freed it. </remarks>
+
+static void PushEvent (EventRing* ring, const NDP_Event* event)
+{
+	unsigned long long position = __atomic_load_n (&ring->Head, __ATOMIC_RELAXED);
+	EventCell* cell;
+
+	while (1)
+	{
+		cell = &ring->Cells[position & ring->Mask];
+		long long lap = (long long) (__atomic_load_n
+			(&cell->Sequence, __ATOMIC_ACQUIRE) - position);
+
+		// Cell is free, try to claim it
+		if (lap == 0)
+		{
+			if (__atomic_compare_exchange_n (&ring->Head, &position, position + 1,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+
+		// Ring is full
+		else if (lap < 0)
+			{ __atomic_add_fetch (&ring->Drops, 1, __ATOMIC_RELAXED); return; }
+
+		// Another producer claimed it
+		else position = __atomic_load_n (&ring->Head, __ATOMIC_RELAXED);
+	}
+
+	cell->Event = *event;
+	__atomic_store_n (&cell->Sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Delivers a neighbor event to the callback or the ring. </summary>
+
+static void EmitEvent (NDP_State* state, int type,
+	const NDP_Addr* addr, unsigned long long now)
+{
+	NDP_Event event;
+	event.Type = type;
+	event.Addr = *addr;
+	event.Time = now;
+
+	if (state->EventCallback != NULL)
+		state->EventCallback (&event, state->EventData);
+
+	else if (state->Events != NULL)
+		PushEvent ((EventRing*) state->Events, &event);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Statistics                                                                 //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds to a counter owned by the calling thread. </summary>
+/// <remarks> Each counter has a single writer, so a relaxed store is
+///           enough to keep concurrent readers from tearing it. </remarks>
+
+#define COUNT(counter, n) __atomic_store_n \
+	(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the current monotonic time in nanoseconds. </summary>
+
+static unsigned long long NowNS (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the wall clock time in nanoseconds. </summary>
+/// <remarks> Kernel receive timestamps are taken on this clock. </remarks>
+
+static unsigned long long WallNS (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds a duration to a histogram with log2 buckets. </summary>
+
+static void Record (unsigned long long* histogram, unsigned long long ns)
+{
+	int bucket = 63 - __builtin_clzll (ns | 1);
+	if (bucket >= NDP_HISTOGRAM_LEN)
+		bucket = NDP_HISTOGRAM_LEN - 1;
+
+	COUNT (histogram[bucket], 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds the counters of one statistics block to another. </summary>
+
+static void AddStats (NDP_Stats* total, const NDP_Stats* stats)
+{
+	const unsigned long long* from = (const unsigned long long*) stats;
+	unsigned long long* to = (unsigned long long*) total;
+	unsigned int i;
+
+	// The block is made up of counters only
+	for (i = 0; i < sizeof (NDP_Stats) / sizeof (*to); ++i)
+		to[i] += __atomic_load_n (&from[i], __ATOMIC_RELAXED);
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Capture                                                                    //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Opens the capture file and writes the pcap header. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateCapture (NDP_State* state)
+{
+	FILE* file = fopen (state->CapturePath, "wb");
+	if (file == NULL)
+		return -1;
+
+	PcapHeader header;
+	header.Magic    = PCAP_MAGIC_NS;
+	header.Major    = 2;
+	header.Minor    = 4;
+	header.Zone     = 0;
+	header.Accuracy = 0;
+	header.SnapLen  = NDP_BEACON_MAX_LEN;
+	header.LinkType = PCAP_ETHERNET;
+
+	if (fwrite (&header, sizeof (header), 1, file) != 1)
+		{ fclose (file); return -1; }
+
+	state->Capture = file;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Queues a beacon to be appended to the capture file. </summary>
+/// <remarks> Called with the table locked, so nothing is written to the
+///           file until FlushCapture is called after unlocking it. </remarks>
+
+static void CaptureBeacon (NDP_State* state,
+	const Beacon* beacon, unsigned int length)
+{
+	if (length > sizeof (Beacon))
+		length = sizeof (Beacon);
+
+	// Make room for the record
+	unsigned int needed = state->CaptureLen + sizeof (PcapRecord) + length;
+	if (needed > state->CaptureSize)
+	{
+		unsigned int size = state->CaptureSize ? state->CaptureSize * 2 : 4096;
+		while (size < needed)
+			size *= 2;
+
+		char* queue = (char*) realloc (state->CaptureQueue, size);
+		if (queue == NULL)
+			return;
+
+		state->CaptureQueue = queue;
+		state->CaptureSize  = size;
+	}
+
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+
+	PcapRecord header;
+	header.Seconds  = (uint32_t) now.tv_sec;
+	header.Fraction = (uint32_t) now.tv_nsec;
+	header.Length   = length;
+	header.Original = length;
+
+	memcpy (state->CaptureQueue + state->CaptureLen, &header, sizeof (header));
+	memcpy (state->CaptureQueue + state->CaptureLen + sizeof (header), beacon, length);
+	state->CaptureLen = needed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Appends the queued beacons to the capture file. </summary>
+/// <remarks> Records are written with a single call which stdio locks,
+///           so shards may share the file. </remarks>
+
+static void FlushCapture (NDP_State* state)
+{
+	if (state->CaptureLen == 0)
+		return;
+
+	if (state->Capture != NULL)
+		fwrite (state->CaptureQueue, state->CaptureLen, 1, (FILE*) state->Capture);
+
+	state->CaptureLen = 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Trickle                                                                    //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the next value of a xorshift64* generator. </summary>
+
+static unsigned long long NextRandom (unsigned long long* seed)
+{
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return *seed * 0x2545F4914F6CDD1DULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Starts a new interval of the adaptive schedule. </summary>
+/// <remarks> The beacon is decided on at a random point in the second
+///           half of the interval so neighbors do not beacon together. </remarks>
+
+static void TrickleBegin (NDP_State* state, unsigned long long now)
+{
+	unsigned int half = state->TrickleInterval / 2;
+
+	state->TrickleStart = now;
+	state->TrickleFire  = now + half + NextRandom
+		(&state->TrickleSeed) % (state->TrickleInterval - half);
+
+	state->TrickleDone = 0;
+	__atomic_store_n (&state->TrickleHeard, 0, __ATOMIC_RELAXED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Makes the send timer of a state on an engine fire now. </summary>
+
+static void WakeSender (NDP_State* state)
+{
+	if (state->SendTimer < 0 || state->Silent != 0)
+		return;
+
+	struct itimerspec spec;
+	memset (&spec, 0, sizeof (spec));
+	spec.it_value.tv_nsec = 1;
+
+	timerfd_settime (state->SendTimer, 0, &spec, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Reports a neighbor event to the adaptive schedule. </summary>
+/// <remarks> Beacons of known neighbors count towards suppressing ours,
+///           arrivals and departures restart the schedule. Called from
+///           every receiving thread, shards report to their parent and
+///           wake its engine, which rarely receives anything itself. </remarks>
+
+static void TrickleHear (NDP_State* state, int type)
+{
+	NDP_State* owner = state->Parent != NULL ? state->Parent : state;
+	if (owner->Adaptive == 0)
+		return;
+
+	if (type == NDP_NEIGHBOR_REFRESH)
+		__atomic_add_fetch (&owner->TrickleHeard, 1, __ATOMIC_RELAXED);
+
+	else if (__atomic_exchange_n (&owner->TrickleReset, 1,
+		__ATOMIC_SEQ_CST) == 0 && owner != state)
+		WakeSender (owner);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Advances the adaptive schedule to the time (ms). </summary>
+/// <remarks> Sets send when a beacon is due, only the sending thread may
+///           call this. Call it again at the latest by the returned time
+///           or as soon as TrickleReset is set. </remarks>
+/// <returns> Time at which the schedule must be advanced again. </returns>
+
+static unsigned long long TrickleStep
+	(NDP_State* state, unsigned long long now, int* send)
+{
+	*send = 0;
+
+	// Restart when the neighborhood changes
+	if (__atomic_exchange_n (&state->TrickleReset, 0, __ATOMIC_RELAXED) != 0 ||
+		state->TrickleInterval == 0)
+	{
+		state->TrickleInterval = state->TrickleMin;
+		TrickleBegin (state, now);
+	}
+
+	// Back off while the neighborhood is stable
+	else if (now >= state->TrickleStart + state->TrickleInterval)
+	{
+		state->TrickleInterval *= 2;
+		if (state->TrickleInterval > (unsigned int) state->TrickleMax)
+			state->TrickleInterval = state->TrickleMax;
+
+		TrickleBegin (state, now);
+	}
+
+	int suppress = 0;
+
+	// Beacon unless enough neighbors were heard
+	if (state->TrickleDone == 0 && now >= state->TrickleFire)
+	{
+		state->TrickleDone = 1;
+		if (__atomic_load_n (&state->TrickleHeard, __ATOMIC_RELAXED)
+			< (unsigned int) state->TrickleRedundancy)
+			*send = 1; else suppress = 1;
+	}
+
+	// Keep neighbors from expiring us
+	unsigned long long deadline = state->TrickleSent + state->Timeout / 2;
+	if (now >= deadline)
+		{ *send = 1; suppress = 0; }
+
+	if (suppress != 0)
+		COUNT (state->SendStats.BeaconsSuppressed, 1);
+
+	if (*send != 0)
+	{
+		state->TrickleSent = now;
+		deadline = now + state->Timeout / 2;
+	}
+
+	unsigned long long next = state->TrickleDone == 0 ? state->TrickleFire :
+		state->TrickleStart + state->TrickleInterval;
+
+	return next < deadline ? next : deadline;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Link                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Writes the payload of an extended beacon. </summary>
+/// <returns> Length of the beacon frame. </returns>
+
+static unsigned int WritePayload (Beacon* beacon,
+	unsigned int number, unsigned long long time)
+{
+	unsigned char* field = beacon->Payload;
+	uint32_t sequence = htonl (number);
+	uint64_t sent = htobe64 (time);
+
+	*field++ = NDP_BEACON_VERSION;
+
+	*field++ = NDP_FIELD_SEQUENCE;
+	*field++ = sizeof (sequence);
+	memcpy (field, &sequence, sizeof (sequence));
+	field += sizeof (sequence);
+
+	*field++ = NDP_FIELD_TIMESTAMP;
+	*field++ = sizeof (sent);
+	memcpy (field, &sent, sizeof (sent));
+	field += sizeof (sent);
+
+	return (unsigned int) (field - (unsigned char*) beacon);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Writes the payload of the next beacon of the state. </summary>
+/// <remarks> Every beacon takes the next sequence number of the state. </remarks>
+/// <returns> Length of the beacon frame. </returns>
+
+static unsigned int StampBeacon (NDP_State* state, Beacon* beacon)
+{
+	return WritePayload (beacon, state->Sequence++, NowNS());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Reads the sequence number and send time of a beacon. </summary>
+/// <remarks> Unknown fields are skipped so newer senders stay readable. </remarks>
+/// <returns> One for extended beacons, zero for legacy ones. </returns>
+
+static int ParseBeacon (const Beacon* beacon, unsigned int length,
+	uint32_t* sequence, uint64_t* sent)
+{
+	const unsigned char* field = beacon->Payload;
+	const unsigned char* end = (const unsigned char*) beacon +
+		(length < sizeof (Beacon) ? length : sizeof (Beacon));
+	int found = 0;
+
+	if (field >= end || *field++ < NDP_BEACON_VERSION)
+		return 0;
+
+	while (field + 2 <= end && field[0] != NDP_FIELD_END)
+	{
+		unsigned int type = field[0];
+		unsigned int size = field[1];
+		field += 2;
+
+		if (field + size > end)
+			break;
+
+		if (type == NDP_FIELD_SEQUENCE && size == sizeof (*sequence))
+		{
+			memcpy (sequence, field, size);
+			*sequence = ntohl (*sequence);
+			found |= 1;
+		}
+
+		if (type == NDP_FIELD_TIMESTAMP && size == sizeof (*sent))
+		{
+			memcpy (sent, field, size);
+			*sent = be64toh (*sent);
+			found |= 2;
+		}
+
+		field += size;
+	}
+
+	return found == 3;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Updates the link tracking of a neighbor with a beacon
+///           which has arrived at the time (ns). </summary>
+/// <remarks> Late beacons only fill in their bit of the window. Jitter
+///           follows RFC 3550, legacy beacons are numbered on arrival
+///           and expected one mean interval after the previous one. </remarks>
+
+static void UpdateLink (NDP_Track* track, int extended,
+	uint32_t sequence, uint64_t sent, unsigned long long arrival)
+{
+	if (extended == 0)
+		sequence = track->Sequence + 1;
+
+	int32_t delta = (int32_t) (sequence - track->Sequence);
+
+	// Restart for new neighbors and restarted senders
+	if (track->Span == 0 || extended != track->Extended ||
+		delta <= -NDP_LINK_WINDOW || arrival < track->Arrival)
+	{
+		track->Window   = 1;
+		track->Span     = 1;
+		track->Sequence = sequence;
+		track->Extended = extended;
+		track->Arrival  = arrival;
+		track->Sent     = sent;
+		track->Interval = 0;
+		track->Jitter   = 0;
+		return;
+	}
+
+	// Fill in late and duplicate beacons within the window
+	if (delta <= 0)
+	{
+		if (-delta < track->Span)
+			track->Window |= 1ULL << -delta;
+		return;
+	}
+
+	track->Window = delta < NDP_LINK_WINDOW ? (track->Window << delta) | 1 : 1;
+	track->Span   = track->Span + delta < NDP_LINK_WINDOW ?
+		track->Span + delta : NDP_LINK_WINDOW;
+
+	// Spread the time across any missing beacons
+	long long elapsed  = (long long) (arrival - track->Arrival);
+	long long interval = elapsed / delta;
+	long long expected = extended ? (long long) (sent - track->Sent) :
+		(long long) track->Interval * delta;
+
+	if (extended != 0 || track->Interval != 0)
+	{
+		long long deviation = elapsed > expected ?
+			elapsed - expected : expected - elapsed;
+		track->Jitter += (deviation - (long long) track->Jitter) / 16;
+	}
+
+	if (track->Interval == 0)
+		 track->Interval = interval;
+	else track->Interval += (interval - (long long) track->Interval) / 8;
+
+	track->Sequence = sequence;
+	track->Arrival  = arrival;
+	track->Sent     = sent;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Summarizes the link quality of a neighbor. </summary>
+
+static void ReadLink (const NDP_Track* track, NDP_Link* link)
+{
+	link->Received = __builtin_popcountll (track->Window);
+	link->Lost     = track->Span - link->Received;
+	link->Interval = (unsigned int) (track->Interval / 1000);
+	link->Jitter   = (unsigned int) (track->Jitter   / 1000);
+	link->Extended = track->Extended;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// NDP                                                                        //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Processes a beacon of the given length that has arrived at
+///           the time (ms), arrival is the same monotonic clock in ns. </summary>
+/// <remarks> Pushes the expiry of the sender back by the timeout. </remarks>
+
+static void ReceiveBeacon (NDP_State* state, const Beacon* beacon,
+	unsigned int length, unsigned long long now, unsigned long long arrival)
+{
+	NDP_Table* table = &state->Table;
+	NDP_Neighbor* neighbor;
+	unsigned int i = TableFind (table, &beacon->SourceAddr);
+
+	// Round the expiry up to the next aging tick
+	unsigned long long expiry = (now + state->Timeout +
+		state->AgeInterval - 1) / state->AgeInterval;
+
+	table->Dirty = 1;
+
+	uint32_t sequence = 0;
+	uint64_t sent = 0;
+	int extended = ParseBeacon (beacon, length, &sequence, &sent);
+
+	// Neighbor already exists
+	if (table->Keys[i] != 0)
+	{
+		table->Seen[i] = now;
+		UpdateLink (&table->Tracks[i], extended, sequence, sent, arrival);
+
+		// Reschedule the neighbor, once per aging tick at most
+		if (table->Expiry[i] != expiry)
+		{
+			table->Expiry[i] = expiry;
+			neighbor = table->Slots[i];
+			neighbor->Expiry = expiry;
+			WheelUnlink (neighbor);
+			WheelLink (&table->Wheel, neighbor);
+		}
+
+		COUNT (state->RecvStats.BeaconsAccepted, 1);
+		if (state->Capture != NULL)
+			CaptureBeacon (state, beacon, length);
+
+		EmitEvent (state, NDP_NEIGHBOR_REFRESH, &beacon->SourceAddr, now);
+		TrickleHear (state, NDP_NEIGHBOR_REFRESH);
+		return;
+	}
+
+	// Enforce the neighbor limit
+	if (state->TableLimit > 0 &&
+		table->Count >= (unsigned int) state->TableLimit)
+		{ COUNT (state->RecvStats.TableDrops, 1); return; }
+
+	// Grow the table to keep the load factor under 3/4
+	if (table->Count + 1 > table->Capacity - (table->Capacity >> 2))
+	{
+		if (TableGrow (table) < 0)
+			{ COUNT (state->RecvStats.TableDrops, 1); return; }
+
+		i = TableFind (table, &beacon->SourceAddr);
+	}
+
+	// Acquire and create an entry
+	neighbor = PoolAcquire (&table->Pool);
+	if (neighbor == NULL)
+		{ COUNT (state->RecvStats.TableDrops, 1); return; }
+
+	neighbor->Addr   = beacon->SourceAddr;
+	neighbor->Expiry = expiry;
+	WheelLink (&table->Wheel, neighbor);
+
+	table->Seen  [i] = now;
+	table->Expiry[i] = expiry;
+	table->Tracks[i].Span = 0;
+	UpdateLink (&table->Tracks[i], extended, sequence, sent, arrival);
+
+	table->Slots[i] = neighbor;
+	SetKey (table, i, PackAddr (&neighbor->Addr));
+	++table->Count;
+	++table->Layout;
+
+	// Only beacons which made it into the table are captured
+	COUNT (state->RecvStats.BeaconsAccepted, 1);
+	if (state->Capture != NULL)
+		CaptureBeacon (state, beacon, length);
+
+	COUNT (state->RecvStats.Inserts, 1);
+	EmitEvent (state, NDP_NEIGHBOR_UP, &neighbor->Addr, now);
+	TrickleHear (state, NDP_NEIGHBOR_UP);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Advances the timing wheel up to the time (ms). </summary>
+/// <remarks> Only neighbors that expired are touched. </remarks>
+
+static void UpdateTable (NDP_State* state, unsigned long long now)
+{
+	NDP_Table* table = &state->Table;
+	NDP_Wheel* wheel = &table->Wheel;
+
+	const unsigned long long mask = NDP_WHEEL_LEN - 1;
+	unsigned long long target = now / state->AgeInterval;
+	int level;
+
+	// Nothing can expire in an empty table
+	if (table->Count == 0 && wheel->Tick < target)
+		wheel->Tick = target;
+
+	while (wheel->Tick < target)
+	{
+		++wheel->Tick;
+
+		// Cascade every level whose slot boundary was crossed
+		for (level = 1; level < NDP_WHEEL_LEVELS &&
+			(wheel->Tick & ((1ULL << (NDP_WHEEL_BITS * level)) - 1)) == 0; ++level)
+			WheelCascade (wheel, level);
+
+		// Release and remove expired neighbors
+		NDP_Neighbor** slot = &wheel->Slots[0][wheel->Tick & mask];
+		while (*slot != NULL)
+		{
+			EmitEvent (state, NDP_NEIGHBOR_DOWN, &(*slot)->Addr, now);
+			TrickleHear (state, NDP_NEIGHBOR_DOWN);
+			COUNT (state->RecvStats.Expiries, 1);
+			TableRemove (table, TableFind (table, &(*slot)->Addr));
+		}
+	}
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Export                                                                     //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Formats the name of a file or segment used by a shard. </summary>
+/// <remarks> The first shard uses the name itself, the others append
+///           their index to it. </remarks>
+
+static void ShardName (const char* base, int shard, char* name, size_t length)
+{
+	if (shard == 0)
+		 snprintf (name, length, "%s", base);
+	else snprintf (name, length, "%s.%d", base, shard);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the shared memory segment of a state. </summary>
+/// <remarks> A segment left by a previous run is unlinked first, its
+///           readers keep their mapping until they reopen. </remarks>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateExport (NDP_State* state, const char* name, int shards)
+{
+	ExportSegment* shared = (ExportSegment*) calloc (1, sizeof (ExportSegment));
+	if (shared == NULL)
+		return -1;
+
+	snprintf (shared->Name, sizeof (shared->Name), "%s", name);
+	shm_unlink (name);
+
+	shared->File = shm_open (name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (shared->File < 0)
+		{ free (shared); return -1; }
+
+	shared->Length = sizeof (NDP_Export) +
+		state->Table.Capacity * sizeof (NDP_Entry);
+
+	if (ftruncate (shared->File, (off_t) shared->Length) < 0)
+		goto fail;
+
+	shared->Segment = (NDP_Export*) mmap (NULL, shared->Length,
+		PROT_READ | PROT_WRITE, MAP_SHARED, shared->File, 0);
+
+	if (shared->Segment == MAP_FAILED)
+		goto fail;
+
+	// Describe the interface, this never changes
+	NDP_Export* segment = shared->Segment;
+	segment->Shards  = shards;
+	segment->IfIndex = state->IfIndex;
+	segment->MTU     = state->MTU;
+	segment->Addr    = state->Addr;
+	segment->Timeout = state->Timeout;
+	segment->Size    = state->Table.Capacity;
+	memcpy (segment->Interface, state->Interface, NDP_IFNAME_LEN);
+
+	segment->Version = NDP_EXPORT_VERSION;
+	__atomic_store_n (&segment->Magic, NDP_EXPORT_MAGIC, __ATOMIC_RELEASE);
+
+	state->Export = shared;
+	return 0;
+
+fail:
+	close (shared->File);
+	shm_unlink (name);
+	free (shared);
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Copies a snapshot and the counters of a state to its segment. </summary>
+/// <remarks> Called by the thread publishing snapshots. Without a snapshot
+///           only the counters are refreshed. </remarks>
+
+static void ExportSnapshot (NDP_State* state,
+	const NDP_Snapshot* snapshot, unsigned long long now)
+{
+	ExportSegment* shared = (ExportSegment*) state->Export;
+	if (shared == NULL)
+		return;
+
+	// Grow the segment along with the table, before
+	// readers can see a size which exceeds the file
+	if (snapshot != NULL && shared->Segment->Size < snapshot->Count)
+	{
+		size_t length = sizeof (NDP_Export) +
+			snapshot->Size * sizeof (NDP_Entry);
+
+		if (ftruncate (shared->File, (off_t) length) < 0)
+			return;
+
+		void* map = mremap (shared->Segment,
+			shared->Length, length, MREMAP_MAYMOVE);
+
+		if (map == MAP_FAILED)
+			return;
+
+		shared->Segment = (NDP_Export*) map;
+		shared->Length  = length;
+	}
+
+	NDP_Export* segment = shared->Segment;
+	NDP_Stats stats;
+	memset (&stats, 0, sizeof (NDP_Stats));
+	AddStats (&stats, &state->RecvStats);
+	AddStats (&stats, &state->SendStats);
+
+	// Readers retry while the sequence is odd or has changed
+	unsigned int sequence = segment->Sequence;
+	__atomic_store_n (&segment->Sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	if (snapshot != NULL)
+	{
+		if (snapshot->Count > 0)
+			memcpy (segment->Entries, snapshot->Entries,
+				snapshot->Count * sizeof (NDP_Entry));
+
+		segment->Size  = (shared->Length -
+			sizeof (NDP_Export)) / sizeof (NDP_Entry);
+		segment->Count = snapshot->Count;
+	}
+
+	segment->Time  = now;
+	segment->Stats = stats;
+
+	__atomic_store_n (&segment->Sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the segments of every shard and fills them. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int OpenExport (NDP_State* state)
+{
+	unsigned long long now = NDP_Time();
+	int i, count = state->WorkerCount + 1;
+	char name[NAME_MAX];
+
+	for (i = 0; i < count; ++i)
+	{
+		NDP_State* shard = i == 0 ? state : &state->Workers[i - 1];
+		ShardName (state->ExportName, i, name, sizeof (name));
+
+		if (CreateExport (shard, name, count) < 0)
+			return -1;
+
+		ExportSnapshot (shard, &shard->Snapshots[shard->Published], now);
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Marks the segment of a state as closed and removes it. </summary>
+
+static void DestroyExport (NDP_State* state)
+{
+	ExportSegment* shared = (ExportSegment*) state->Export;
+	if (shared == NULL)
+		return;
+
+	__atomic_store_n (&shared->Segment->Closed, 1, __ATOMIC_RELEASE);
+	munmap (shared->Segment, shared->Length);
+	close (shared->File);
+	shm_unlink (shared->Name);
+
+	free (shared);
+	state->Export = NULL;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Snapshot                                                                   //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Publishes a copy of the table if it changed and the publish
+///           interval has passed. Must be called with the table locked. </summary>
+/// <remarks> Only buffers without readers are written to, if none are
+///           free the table stays dirty and is published next time. </remarks>
+
+static void PublishSnapshot (NDP_State* state, unsigned long long now)
+{
+	NDP_Table* table = &state->Table;
+	NDP_Snapshot* snapshot = NULL;
+	unsigned int i, n;
+
+	if (table->Dirty == 0 || now - state->
+		PublishTime < (unsigned int) state->PublishInterval)
+		return;
+
+	// Find a buffer that nobody is reading
+	int current = __atomic_load_n (&state->Published, __ATOMIC_SEQ_CST);
+	for (i = 1; i < NDP_SNAPSHOTS; ++i)
+	{
+		NDP_Snapshot* candidate = &state->Snapshots[(current + i) % NDP_SNAPSHOTS];
+		if (__atomic_load_n (&candidate->Readers, __ATOMIC_SEQ_CST) == 0)
+			{ snapshot = candidate; break; }
+	}
+
+	if (snapshot == NULL)
+		return;
+
+	// Make room for every neighbor
+	if (snapshot->Size < table->Count)
+	{
+		NDP_Entry* entries = (NDP_Entry*) realloc (snapshot->
+			Entries, table->Capacity * sizeof (NDP_Entry));
+
+		if (entries == NULL)
+			return;
+
+		snapshot->Entries = entries;
+		snapshot->Size = table->Capacity;
+	}
+
+	// Copy the neighbors
+	for (i = 0, n = 0; i < table->Capacity; ++i)
+		if (table->Keys[i] != 0)
+		{
+			UnpackKey (table->Keys[i], &snapshot->Entries[n].Addr);
+			snapshot->Entries[n].Seen = table->Seen[i];
+			ReadLink (&table->Tracks[i], &snapshot->Entries[n].Link);
+			++n;
+		}
+
+	snapshot->Count   = n;
+	snapshot->Time    = now;
+	snapshot->Version = state->Snapshots[current].Version + 1;
+	snapshot->Layout  = table->Layout;
+
+	// Swap it in for new readers
+	__atomic_store_n (&state->Published, (int)
+		(snapshot - state->Snapshots), __ATOMIC_SEQ_CST);
+
+	state->PublishTime = now;
+	table->Dirty = 0;
+
+	ExportSnapshot (state, snapshot, now);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases the buffers of all snapshots. </summary>
+
+static void DestroySnapshots (NDP_State* state)
+{
+	int i;
+	for (i = 0; i < NDP_SNAPSHOTS; ++i)
+	{
+		free (state->Snapshots[i].Entries);
+		memset (&state->Snapshots[i], 0, sizeof (NDP_Snapshot));
+	}
+
+	state->Published = 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Persist                                                                    //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the wall clock time in milliseconds. </summary>
+/// <remarks> Unlike NDP_Time it stays meaningful across restarts. </remarks>
+
+static unsigned long long WallTime (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the shard which receives beacons from an address. </summary>
+/// <remarks> Mirrors the fanout filter of CreateShards, which picks a
+///           shard from the last four bytes of the source. </remarks>
+
+static NDP_State* ShardOf (NDP_State* state, const NDP_Addr* address)
+{
+	const unsigned char* data = address->Data;
+	uint32_t hash = ((uint32_t) data[2] << 24) | ((uint32_t) data[3] << 16) |
+					((uint32_t) data[4] <<  8) |  (uint32_t) data[5];
+
+	unsigned int shard = hash % (unsigned int) (state->WorkerCount + 1);
+	return shard == 0 ? state : &state->Workers[shard - 1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Checks whether a mapped file holds a complete table. </summary>
+
+static int CheckPersist (const PersistHeader* header, size_t length)
+{
+	return length >= sizeof (PersistHeader) &&
+		header->Magic      == PERSIST_MAGIC   &&
+		header->Version    == PERSIST_VERSION &&
+		header->RecordSize == sizeof (PersistRecord) &&
+		header->Count      <= header->Size    &&
+		(header->Writing & 1) == 0 &&
+		length >= sizeof (PersistHeader) + header->Size * sizeof (PersistRecord);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds a neighbor loaded from a table file. </summary>
+/// <remarks> Link statistics restart with the next beacon. </remarks>
+
+static void RestoreNeighbor (NDP_State* state, const NDP_Addr*
+	address, unsigned long long seen, unsigned long long now)
+{
+	NDP_Table* table = &state->Table;
+	unsigned int i = TableFind (table, address);
+
+	// Files of several shards may both hold it
+	if (table->Keys[i] != 0)
+		return;
+
+	if (state->TableLimit > 0 &&
+		table->Count >= (unsigned int) state->TableLimit)
+		return;
+
+	if (table->Count + 1 > table->Capacity - (table->Capacity >> 2))
+	{
+		if (TableGrow (table) < 0)
+			return;
+
+		i = TableFind (table, address);
+	}
+
+	NDP_Neighbor* neighbor = PoolAcquire (&table->Pool);
+	if (neighbor == NULL)
+		return;
+
+	neighbor->Addr   = *address;
+	neighbor->Expiry = (seen + state->Timeout +
+		state->AgeInterval - 1) / state->AgeInterval;
+	WheelLink (&table->Wheel, neighbor);
+
+	table->Seen  [i] = seen;
+	table->Expiry[i] = neighbor->Expiry;
+	memset (&table->Tracks[i], 0, sizeof (NDP_Track));
+
+	table->Slots[i] = neighbor;
+	SetKey (table, i, PackAddr (address));
+	++table->Count;
+	++table->Layout;
+	table->Dirty = 1;
+
+	COUNT (state->RecvStats.Inserts, 1);
+	EmitEvent (state, NDP_NEIGHBOR_UP, address, now);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds the neighbors of a table file to the shards. </summary>
+/// <remarks> Neighbors are aged by the time passed since they were last
+///           seen, those which would have expired meanwhile are dropped. </remarks>
+
+static void LoadPersist (NDP_State* state, const PersistHeader* header)
+{
+	const PersistRecord* records = (const PersistRecord*) (header + 1);
+	unsigned long long wall = WallTime();
+	unsigned long long now  = NDP_Time();
+	unsigned int i;
+
+	for (i = 0; i < header->Count; ++i)
+	{
+		// Clocks set back count as no time passed
+		unsigned long long age = wall > records[i].Seen ? wall - records[i].Seen : 0;
+		if (age >= (unsigned long long) state->Timeout || age > now)
+			continue;
+
+		RestoreNeighbor (ShardOf (state, &records[i].Addr),
+			&records[i].Addr, now - age, now);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Maps the table file of a state, creating it if needed. </summary>
+/// <remarks> Files which are damaged or from another version are reset. </remarks>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreatePersist (NDP_State* state, const char* name)
+{
+	PersistFile* persist = (PersistFile*) calloc (1, sizeof (PersistFile));
+	if (persist == NULL)
+		return -1;
+
+	persist->File = open (name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (persist->File < 0)
+		{ free (persist); return -1; }
+
+	struct stat info;
+	if (fstat (persist->File, &info) < 0)
+		goto fail;
+
+	// Keep a valid file as it is so it can be loaded
+	persist->Length = (size_t) info.st_size;
+	if (persist->Length >= sizeof (PersistHeader))
+	{
+		persist->Header = (PersistHeader*) mmap (NULL, persist->Length,
+			PROT_READ | PROT_WRITE, MAP_SHARED, persist->File, 0);
+
+		if (persist->Header == MAP_FAILED)
+			goto fail;
+
+		if (CheckPersist (persist->Header, persist->Length))
+			{ state->Persist = persist; return 0; }
+
+		munmap (persist->Header, persist->Length);
+	}
+
+	// Start over with an empty table
+	persist->Length = sizeof (PersistHeader);
+	if (ftruncate (persist->File, 0) < 0 ||
+		ftruncate (persist->File, (off_t) persist->Length) < 0)
+		goto fail;
+
+	persist->Header = (PersistHeader*) mmap (NULL, persist->Length,
+		PROT_READ | PROT_WRITE, MAP_SHARED, persist->File, 0);
+
+	if (persist->Header == MAP_FAILED)
+		goto fail;
+
+	persist->Header->Magic      = PERSIST_MAGIC;
+	persist->Header->Version    = PERSIST_VERSION;
+	persist->Header->RecordSize = sizeof (PersistRecord);
+	state->Persist = persist;
+	return 0;
+
+fail:
+	close (persist->File);
+	free (persist);
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Maps the table files of every shard and reloads them. </summary>
+/// <remarks> Neighbors go to the shard now receiving their beacons, so
+///           the number of shards may change between runs. Files left
+///           over from a run with more shards are loaded and removed. </remarks>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int OpenPersist (NDP_State* state)
+{
+	char name[PATH_MAX];
+	int i, count = state->WorkerCount + 1;
+
+	for (i = 0; i < count; ++i)
+	{
+		ShardName (state->PersistPath, i, name, sizeof (name));
+		if (CreatePersist (i == 0 ? state : &state->Workers[i - 1], name) < 0)
+			return -1;
+	}
+
+	// Nothing is saved until the states are started
+	for (i = 0; i < count; ++i)
+		LoadPersist (state, ((PersistFile*) (i == 0 ?
+			state->Persist : state->Workers[i - 1].Persist))->Header);
+
+	for (i = count; i < NDP_SHARDS_MAX; ++i)
+	{
+		ShardName (state->PersistPath, i, name, sizeof (name));
+		int file = open (name, O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+			continue;
+
+		struct stat info;
+		if (fstat (file, &info) == 0 && info.st_size >= (off_t) sizeof (PersistHeader))
+		{
+			void* map = mmap (NULL, (size_t) info.st_size,
+				PROT_READ, MAP_SHARED, file, 0);
+
+			if (map != MAP_FAILED)
+			{
+				if (CheckPersist ((const PersistHeader*) map, (size_t) info.st_size))
+					LoadPersist (state, (const PersistHeader*) map);
+				munmap (map, (size_t) info.st_size);
+			}
+		}
+
+		close (file);
+		unlink (name);
+	}
+
+	// Readers see the neighbors right away
+	unsigned long long now = NDP_Time();
+	PublishSnapshot (state, now);
+	for (i = 0; i < state->WorkerCount; ++i)
+		PublishSnapshot (&state->Workers[i], now);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Writes the table of a state into its file. </summary>
+/// <remarks> Only runs every PersistInterval. The file is mapped, so
+///           a save costs no system calls unless the file must grow. </remarks>
+
+static void SavePersist (NDP_State* state, unsigned long long now)
+{
+	PersistFile* persist = (PersistFile*) state->Persist;
+	NDP_Table* table = &state->Table;
+	unsigned int i, n;
+
+	if (persist == NULL || now - state->
+		PersistTime < (unsigned int) state->PersistInterval)
+		return;
+
+	// Grow the file along with the table
+	if (persist->Header->Size < table->Count)
+	{
+		size_t length = sizeof (PersistHeader) +
+			table->Capacity * sizeof (PersistRecord);
+
+		if (ftruncate (persist->File, (off_t) length) < 0)
+			return;
+
+		void* map = mremap (persist->Header,
+			persist->Length, length, MREMAP_MAYMOVE);
+
+		if (map == MAP_FAILED)
+			return;
+
+		persist->Header = (PersistHeader*) map;
+		persist->Length = length;
+		persist->Header->Size = table->Capacity;
+	}
+
+	PersistHeader* header = persist->Header;
+	PersistRecord* records = (PersistRecord*) (header + 1);
+	unsigned long long wall = WallTime();
+
+	// Mark the file as torn until the save completes
+	__atomic_add_fetch (&header->Writing, 1, __ATOMIC_RELEASE);
+
+	for (i = 0, n = 0; i < table->Capacity; ++i)
+		if (table->Keys[i] != 0)
+		{
+			UnpackKey (table->Keys[i], &records[n].Addr);
+			records[n].Reserved[0] = 0;
+			records[n].Reserved[1] = 0;
+			records[n].Seen = wall - (now - table->Seen[i]);
+			++n;
+		}
+
+	header->Count = n;
+	header->Saved = wall;
+	__atomic_add_fetch (&header->Writing, 1, __ATOMIC_RELEASE);
+
+	state->PersistTime = now;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Flushes and unmaps the table file of a state. </summary>
+
+static void DestroyPersist (NDP_State* state)
+{
+	PersistFile* persist = (PersistFile*) state->Persist;
+	if (persist == NULL)
+		return;
+
+	msync  (persist->Header, persist->Length, MS_SYNC);
+	munmap (persist->Header, persist->Length);
+	close  (persist->File);
+	free   (persist);
+	state->Persist = NULL;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Receiving                                                                  //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the kernel receive timestamp of a message (ns). </summary>
+/// <returns> Zero if the message does not carry one. </returns>
+
+static unsigned long long KernelTime (struct msghdr* message)
+{
+	struct cmsghdr* control;
+	for (control = CMSG_FIRSTHDR (message); control != NULL;
+		 control = CMSG_NXTHDR (message, control))
+	{
+		if (control->cmsg_level == SOL_SOCKET &&
+			control->cmsg_type  == SCM_TIMESTAMPNS)
+		{
+			struct timespec time;
+			memcpy (&time, CMSG_DATA (control), sizeof (time));
+			return time.tv_sec * 1000000000ULL + time.tv_nsec;
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Records the time since the kernel received a beacon. </summary>
+
+static void RecordWire (NDP_State* state, unsigned long long received)
+{
+	unsigned long long now = WallNS();
+	if (received != 0 && now > received)
+		Record (state->RecvStats.WireLatency, now - received);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Receives all pending beacons through recvmsg. </summary>
+
+static void ReceiveSocket (NDP_State* state)
+{
+	/// Create a beacon
+	Beacon beacon;
+
+	/// Set the source address
+	struct sockaddr_ll from;
+	char control[CONTROL_LEN];
+
+	struct iovec vector;
+	vector.iov_base = &beacon;
+	vector.iov_len  = sizeof (beacon);
+
+	struct msghdr message;
+	memset (&message, 0, sizeof (message));
+
+	message.msg_name   = &from;
+	message.msg_iov    = &vector;
+	message.msg_iovlen = 1;
+
+	while (1)
+	{
+		// Reset network values
+		message.msg_namelen    = sizeof (from);
+		message.msg_control    = control;
+		message.msg_controllen = sizeof (control);
+		memset (&beacon, 0, sizeof (beacon));
+
+		// Non blocking receive beacon
+		ssize_t length = recvmsg (state->SocketID, &message, MSG_DONTWAIT);
+
+		if (length < 0)
+			return;
+
+		COUNT (state->RecvStats.FramesReceived, 1);
+
+		// Check for correct protocol type
+		if (length >= NDP_BEACON_HEADER_LEN &&
+			beacon.Type == htons (NDP_BEACON_TYPE))
+		{
+			unsigned long long start = NowNS();
+			unsigned long long now = NDP_Time();
+			NDP_Lock (state);
+
+			unsigned long long locked = NowNS();
+			ReceiveBeacon (state, &beacon, length, now, start);
+
+			if (state->Timestamps != 0)
+				RecordWire (state, KernelTime (&message));
+
+			PublishSnapshot (state, now);
+
+			unsigned long long end = NowNS();
+			NDP_Unlock (state);
+			FlushCapture (state);
+
+			Record (state->RecvStats.LockHold, end - locked);
+			Record (state->RecvStats.Latency,  end - start );
+		}
+
+		else COUNT (state->RecvStats.FramesFiltered, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Receives all pending beacons in batches with recvmmsg. </summary>
+/// <remarks> The table is locked once for every batch of beacons. </remarks>
+
+static void ReceiveBatch (NDP_State* state)
+{
+	Batch* batch = (Batch*) state->Batch;
+	int i, n, size = state->BatchSize;
+
+	while (1)
+	{
+		for (i = 0; i < size; ++i)
+		{
+			batch->Headers[i].msg_hdr.msg_flags = 0;
+			batch->Headers[i].msg_hdr.msg_controllen = CONTROL_LEN;
+		}
+
+		n = recvmmsg (state->SocketID, batch->Headers,
+			size, MSG_DONTWAIT, NULL);
+
+		if (n <= 0)
+			return;
+
+		state->Batches     += 1;
+		state->BatchFrames += n;
+		COUNT (state->RecvStats.FramesReceived, n);
+
+		unsigned long long start = NowNS();
+		unsigned long long now = NDP_Time();
+		NDP_Lock (state);
+
+		unsigned long long locked = NowNS();
+		for (i = 0; i < n; ++i)
+		{
+			// Check for correct protocol type
+			if (batch->Headers[i].msg_len >= NDP_BEACON_HEADER_LEN &&
+				batch->Beacons[i].Type == htons (NDP_BEACON_TYPE))
+			{
+				ReceiveBeacon (state, &batch->Beacons[i],
+					batch->Headers[i].msg_len, now, start);
+
+				if (state->Timestamps != 0)
+					RecordWire (state, KernelTime (&batch->Headers[i].msg_hdr));
+			}
+
+			else COUNT (state->RecvStats.FramesFiltered, 1);
+		}
+
+		PublishSnapshot (state, now);
+
+		unsigned long long end = NowNS();
+		NDP_Unlock (state);
+		FlushCapture (state);
+
+		Record (state->RecvStats.LockHold, end - locked);
+		Record (state->RecvStats.Latency,  end - start );
+
+		// Nothing left to drain
+		if (n < size)
+			return;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Receives all beacons in blocks retired to the ring. </summary>
+/// <remarks> The table is locked once for every block of beacons. </remarks>
+
+static void ReceiveRing (NDP_State* state)
+{
+	unsigned int i;
+
+	while (1)
+	{
+		struct tpacket_block_desc* block = (struct tpacket_block_desc*)
+			((char*) state->Ring + state->RingBlock * RING_BLOCK_SIZE);
+
+		// Wait until the kernel hands over the block
+		if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+			return;
+
+		__sync_synchronize();
+
+		struct tpacket3_hdr* frame = (struct tpacket3_hdr*)
+			((char*) block + block->hdr.bh1.offset_to_first_pkt);
+
+		COUNT (state->RecvStats.FramesReceived, block->hdr.bh1.num_pkts);
+
+		unsigned long long start = NowNS();
+		unsigned long long now = NDP_Time();
+		NDP_Lock (state);
+
+		unsigned long long locked = NowNS();
+		for (i = 0; i < block->hdr.bh1.num_pkts; ++i)
+		{
+			const Beacon* beacon = (const Beacon*)
+				((char*) frame + frame->tp_mac);
+
+			// Check for correct protocol type
+			if (frame->tp_snaplen >= NDP_BEACON_HEADER_LEN &&
+				beacon->Type == htons (NDP_BEACON_TYPE))
+			{
+				ReceiveBeacon (state, beacon,
+					frame->tp_snaplen, now, start);
+
+				// Frames carry the wall clock time the kernel received
+				// them, which only suits the wire latency
+				if (state->Timestamps != 0)
+					RecordWire (state, frame->tp_sec *
+						1000000000ULL + frame->tp_nsec);
+			}
+
+			else COUNT (state->RecvStats.FramesFiltered, 1);
+
+			frame = (struct tpacket3_hdr*)
+				((char*) frame + frame->tp_next_offset);
+		}
+
+		PublishSnapshot (state, now);
+
+		unsigned long long end = NowNS();
+		NDP_Unlock (state);
+		FlushCapture (state);
+
+		Record (state->RecvStats.LockHold, end - locked);
+		Record (state->RecvStats.Latency,  end - start );
+
+		// Return the block to the kernel
+		__sync_synchronize();
+		block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		state->RingBlock = (state->RingBlock + 1) % RING_BLOCK_NR;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Receives all pending beacons using the chosen backend. </summary>
+
+static void ReceiveFrames (NDP_State* state)
+{
+	if (state->Ring  != NULL) ReceiveRing   (state); else
+	if (state->Batch != NULL) ReceiveBatch  (state); else
+							  ReceiveSocket (state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases the buffers used to receive batches. </summary>
+
+static void DestroyBatch (NDP_State* state)
+{
+	Batch* batch = (Batch*) state->Batch;
+	if (batch != NULL)
+	{
+		free (batch->Headers);
+		free (batch->Vectors);
+		free (batch->Beacons);
+		free (batch->Controls);
+		free (batch);
+		state->Batch = NULL;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Allocates the buffers used to receive batches. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateBatch (NDP_State* state)
+{
+	int i;
+
+	// Clamp the batch size
+	if (state->BatchSize <= 0        ) state->BatchSize = NDP_BATCH_LEN;
+	if (state->BatchSize >  BATCH_MAX) state->BatchSize = BATCH_MAX;
+
+	int size = state->BatchSize;
+	Batch* batch = (Batch*) calloc (1, sizeof (Batch));
+	if (batch == NULL)
+		return -1;
+
+	state->Batch = batch;
+	batch->Headers = (struct mmsghdr*) calloc (size, sizeof (struct mmsghdr));
+	batch->Vectors = (struct iovec*  ) calloc (size, sizeof (struct iovec  ));
+	batch->Beacons = (Beacon*        ) calloc (size, sizeof (Beacon        ));
+	batch->Controls = (char*         ) calloc (size, CONTROL_LEN);
+
+	if (batch->Headers  == NULL ||
+		batch->Vectors  == NULL ||
+		batch->Beacons  == NULL ||
+		batch->Controls == NULL)
+		{ DestroyBatch (state); return -1; }
+
+	// Point every message at its own beacon
+	for (i = 0; i < size; ++i)
+	{
+		batch->Vectors[i].iov_base = &batch->Beacons[i];
+		batch->Vectors[i].iov_len  = sizeof (Beacon);
+
+		batch->Headers[i].msg_hdr.msg_iov    = &batch->Vectors[i];
+		batch->Headers[i].msg_hdr.msg_iovlen = 1;
+		batch->Headers[i].msg_hdr.msg_control = batch->Controls + i * CONTROL_LEN;
+	}
+
+	state->Batches     = 0;
+	state->BatchFrames = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Applies the socket options of the low latency profile. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int SetLowLatency (NDP_State* state)
+{
+	int enable = 1;
+
+	// Let the kernel poll the device while receiving
+	if (state->BusyPoll > 0 && setsockopt (state->SocketID, SOL_SOCKET,
+		SO_BUSY_POLL, &state->BusyPoll, sizeof (state->BusyPoll)) < 0)
+		return -1;
+
+	// Hand beacons straight to the driver
+	if (setsockopt (state->SocketID, SOL_PACKET,
+		PACKET_QDISC_BYPASS, &enable, sizeof (enable)) < 0)
+		return -1;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Maps a TPACKET_V3 receive ring onto the socket. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateRing (NDP_State* state)
+{
+	int version = TPACKET_V3;
+	if (setsockopt (state->SocketID, SOL_PACKET,
+		PACKET_VERSION, &version, sizeof (version)) < 0)
+		return -1;
+
+	struct tpacket_req3 req;
+	memset (&req, 0, sizeof (req));
+
+	req.tp_block_size       = RING_BLOCK_SIZE;
+	req.tp_block_nr         = RING_BLOCK_NR;
+	req.tp_frame_size       = TPACKET_ALIGNMENT << 7;
+	req.tp_frame_nr         = RING_BLOCK_SIZE /
+		req.tp_frame_size * RING_BLOCK_NR;
+	req.tp_retire_blk_tov   = state->LowLatency != 0 ? 1 : RING_TIMEOUT;
+
+	if (setsockopt (state->SocketID, SOL_PACKET,
+		PACKET_RX_RING, &req, sizeof (req)) < 0)
+		return -1;
+
+	void* ring = mmap (NULL, RING_BLOCK_SIZE * RING_BLOCK_NR,
+		PROT_READ | PROT_WRITE, MAP_SHARED, state->SocketID, 0);
+
+	if (ring == MAP_FAILED)
+		return -1;
+
+	state->Ring      = ring;
+	state->RingBlock = 0;
+	return 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Threading                                                                  //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates a broadcast beacon and its destination address. </summary>
+
+static void CreateBeacon (const NDP_State* state,
+	Beacon* beacon, struct sockaddr_ll* to)
+{
+	int i;
+
+	/// Create a beacon
+	memset (beacon, 0, sizeof (Beacon));
+	for (i = 0; i < NDP_ADDR_LEN; ++i)
+		beacon->TargetAddr.Data[i] = 255;
+
+	beacon->SourceAddr = state->Addr;
+	beacon->Type       = htons (NDP_BEACON_TYPE);
+
+	/// Set the destination address
+	memset (to, 0, sizeof (struct sockaddr_ll));
+
+	to->sll_family  = AF_PACKET;
+	to->sll_pkttype = PACKET_BROADCAST;
+	to->sll_ifindex = state->IfIndex;
+
+	to->sll_halen = NDP_ADDR_LEN;
+	for (i = 0; i < NDP_ADDR_LEN; ++i)
+		to->sll_addr[i] = 255;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Broadcasts a single beacon of the state. </summary>
+
+static void SendBeacon (NDP_State* state)
+{
+	Beacon beacon;
+	struct sockaddr_ll to;
+	CreateBeacon (state, &beacon, &to);
+	unsigned int length = StampBeacon (state, &beacon);
+
+	// Send beacon
+	if (sendto (state->SocketID, &beacon, length,
+		0, (struct sockaddr*) &to, sizeof (to)) < 0)
+		 COUNT (state->SendStats.SendErrors,  1);
+	else COUNT (state->SendStats.BeaconsSent, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Expires neighbors and publishes the table. </summary>
+
+static void AgeTable (NDP_State* state)
+{
+	unsigned long long now = NDP_Time();
+	NDP_Lock (state);
+
+	unsigned long long locked = NowNS();
+	UpdateTable (state, now);
+	PublishSnapshot (state, now);
+	SavePersist (state, now);
+
+	// Keep the exported counters current
+	if (state->PublishTime != now)
+		ExportSnapshot (state, NULL, now);
+
+	Record (state->RecvStats.LockHold, NowNS() - locked);
+	NDP_Unlock (state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates a thread pinned to a CPU with a real time priority. </summary>
+/// <remarks> A negative CPU and a zero priority are left to the scheduler. </remarks>
+/// <returns> Zero for success, an error number for failure. </returns>
+
+static int CreateThread (pthread_t* thread, int cpu,
+	int priority, void* (*routine) (void*), void* parameter)
+{
+	pthread_attr_t attr;
+	pthread_attr_init (&attr);
+
+	if (cpu >= 0 && cpu < CPU_SETSIZE)
+	{
+		cpu_set_t set;
+		CPU_ZERO (&set);
+		CPU_SET (cpu, &set);
+		pthread_attr_setaffinity_np (&attr, sizeof (set), &set);
+	}
+
+	if (priority > 0)
+	{
+		struct sched_param param;
+		memset (&param, 0, sizeof (param));
+		param.sched_priority = priority;
+
+		pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy  (&attr, SCHED_FIFO);
+		pthread_attr_setschedparam   (&attr, &param);
+	}
+
+	int result = pthread_create (thread, &attr, routine, parameter);
+	pthread_attr_destroy (&attr);
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Thread that handles sending beacon packets. </summary>
+
+static void* SendThread (void* parameters)
+{
+	/// Retrieve the NDP state
+	NDP_State* state = (NDP_State*) parameters;
+
+	/// Create a beacon
+	Beacon beacon;
+	struct sockaddr_ll to;
+	int tolen = sizeof (to);
+	CreateBeacon (state, &beacon, &to);
+
+	/// Broadcast periodically
+	unsigned int elapsed = state->BeaconInterval * 1000;
+	unsigned long long next = 0;
+	int send = 0;
+
+	/// Enter the send loop
+	while (state->Active)
+	{
+		// Send adaptively
+		if (state->Adaptive != 0)
+		{
+			unsigned long long now = NDP_Time();
+			if (state->Silent == 0 && (now >= next || state->TrickleReset != 0))
+				next = TrickleStep (state, now, &send);
+		}
+
+		// Send normally
+		else if (elapsed >= state->BeaconInterval * 1000U && state->Silent == 0)
+		{
+			send = 1;
+
+			// Reset timer
+			elapsed = 0;
+		}
+
+		if (send != 0)
+		{
+			// Send beacon
+			if (sendto (state->SocketID, &beacon, StampBeacon (state,
+				&beacon), 0, (struct sockaddr*) &to, tolen) < 0)
+				 COUNT (state->SendStats.SendErrors,  1);
+			else COUNT (state->SendStats.BeaconsSent, 1);
+
+			send = 0;
+		}
+
+		// Sleep for 100 ms
+		usleep (10000);
+		elapsed += 10000;
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Thread that handles receiving beacon packets. </summary>
+
+static void* RecvThread (void* parameters)
+{
+	/// Retrieve the NDP state
+	NDP_State* state = (NDP_State*) parameters;
+
+	/// Update the table periodically
+	unsigned int elapsed = 0;
+	unsigned long long last = NowNS();
+
+	/// Enter the receive loop
+	while (state->Active)
+	{
+		// Receive pending beacons
+		ReceiveFrames (state);
+
+		// Update the table
+		if (elapsed >= state->AgeInterval * 1000U)
+		{
+			AgeTable (state);
+
+			// Reset timer
+			elapsed = 0;
+		}
+
+		// Poll again right away in the low latency profile
+		if (state->LowLatency != 0)
+		{
+			unsigned long long now = NowNS();
+			elapsed += (unsigned int) ((now - last) / 1000);
+			last = now;
+			continue;
+		}
+
+		// Sleep for 100 ms
+		usleep (9000);
+		elapsed += 9000;
+	}
+
+	return NULL;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Sharding                                                                   //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Discards every frame queued on a socket. </summary>
+
+static void DrainSocket (int socket)
+{
+	char discard;
+	while (recv (socket, &discard, sizeof (discard), MSG_DONTWAIT) >= 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the workers of a state and joins all of their
+///           sockets to a fanout group which hashes on the source. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateShards (NDP_State* state)
+{
+	int i, count = state->Shards;
+	if (count > NDP_SHARDS_MAX)
+		count = NDP_SHARDS_MAX;
+
+	state->Workers = (NDP_State*) calloc (count - 1, sizeof (NDP_State));
+	if (state->Workers == NULL)
+		return -1;
+
+	state->WorkerCount = count - 1;
+	for (i = 0; i < state->WorkerCount; ++i)
+	{
+		NDP_State* worker = &state->Workers[i];
+		NDP_Init (worker);
+
+		// Share the configuration of the state
+		memcpy (worker->Interface, state->Interface, NDP_IFNAME_LEN);
+		worker->Promisc         = state->Promisc;
+		worker->Backend         = state->Backend;
+		worker->BatchSize       = state->BatchSize;
+		worker->BeaconInterval  = state->BeaconInterval;
+		worker->AgeInterval     = state->AgeInterval;
+		worker->Timeout         = state->Timeout;
+		worker->PublishInterval = state->PublishInterval;
+		worker->PersistInterval = state->PersistInterval;
+
+		// Shards run on the CPUs following the receive CPU
+		worker->LowLatency = state->LowLatency;
+		worker->BusyPoll   = state->BusyPoll;
+		worker->Priority   = state->Priority;
+		worker->Timestamps = state->Timestamps;
+		worker->RecvCPU    = state->RecvCPU < 0 ? -1 : (int)
+			((state->RecvCPU + i + 1) % sysconf (_SC_NPROCESSORS_ONLN));
+
+		// Split the table between the shards
+		worker->TableSize  = (state->TableSize  + count - 1) / count;
+		worker->TableLimit = (state->TableLimit + count - 1) / count;
+
+		// Workers only receive on their own engine
+		worker->Mode   = NDP_MODE_EVENT;
+		worker->Silent = 1;
+		worker->Parent = state;
+
+		// Workers report into the ring and capture of the state
+		worker->Capture       = state->Capture;
+		worker->Events        = state->Events;
+		worker->EventCallback = state->EventCallback;
+		worker->EventData     = state->EventData;
+
+		NDP_Create (worker);
+		if (worker->Error != 0)
+			return -1;
+	}
+
+	state->TableLimit = (state->TableLimit + count - 1) / count;
+
+	// Let the kernel pick a unique group ID
+	int fanout = (PACKET_FANOUT_CBPF | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+	socklen_t length = sizeof (fanout);
+
+	if (setsockopt (state->SocketID, SOL_PACKET,
+		PACKET_FANOUT, &fanout, sizeof (fanout)) < 0 ||
+		getsockopt (state->SocketID, SOL_PACKET,
+		PACKET_FANOUT, &fanout, &length) < 0)
+		return -1;
+
+	// Pick the shard from the last four bytes of the source,
+	// fanout runs before the link layer header gets pushed
+	struct sock_filter code[] =
+	{
+		BPF_STMT (BPF_LD  | BPF_W | BPF_ABS, SKF_LL_OFF + 8),
+		BPF_STMT (BPF_RET | BPF_A, 0),
+	};
+
+	struct sock_fprog filter;
+	filter.len    = sizeof (code) / sizeof (code[0]);
+	filter.filter = code;
+
+	if (setsockopt (state->SocketID, SOL_PACKET,
+		PACKET_FANOUT_DATA, &filter, sizeof (filter)) < 0)
+		return -1;
+
+	// Join the workers to the same group
+	fanout = (fanout & 0xFFFF) | (PACKET_FANOUT_CBPF << 16);
+	for (i = 0; i < state->WorkerCount; ++i)
+		if (setsockopt (state->Workers[i].SocketID, SOL_PACKET,
+			PACKET_FANOUT, &fanout, sizeof (fanout)) < 0)
+			return -1;
+
+	// Frames queued before joining may belong to other shards
+	for (i = 0; i < state->WorkerCount; ++i)
+		DrainSocket (state->Workers[i].SocketID);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Starts the workers of a state on their own engines. </summary>
+
+static void StartShards (NDP_State* state)
+{
+	int i;
+	for (i = 0; i < state->WorkerCount; ++i)
+		NDP_Start (&state->Workers[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Stops the workers of a state. </summary>
+
+static void StopShards (NDP_State* state)
+{
+	int i;
+	for (i = 0; i < state->WorkerCount; ++i)
+		NDP_Stop (&state->Workers[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Destroys and releases the workers of a state. </summary>
+
+static void DestroyShards (NDP_State* state)
+{
+	int i;
+	if (state->Workers == NULL)
+		return;
+
+	for (i = 0; i < state->WorkerCount; ++i)
+	{
+		// The event ring and capture are owned by the state
+		state->Workers[i].Events  = NULL;
+		state->Workers[i].Capture = NULL;
+		NDP_Destroy (&state->Workers[i]);
+	}
+
+	free (state->Workers);
+	state->Workers = NULL;
+	state->WorkerCount = 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Engine                                                                     //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Sources of events registered with the engine. </summary>
+/// <remarks> Tags are the index of the state shifted left by two bits
+///           combined with the source, the stop event has its own tag. </remarks>
+
+enum
+{
+	SOURCE_SOCKET = 0,		// Beacons are pending
+	SOURCE_SEND,			// Beacon timer expired
+	SOURCE_AGE,				// Aging timer expired
+};
+
+#define SOURCE_STOP (~0ULL)
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Arms a timer to fire now and then every period (in ms). </summary>
+
+static void ArmTimer (int timer, unsigned int period)
+{
+	struct itimerspec spec;
+
+	spec.it_interval.tv_sec  =  period / 1000;
+	spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+	spec.it_value.tv_sec     = 0;
+	spec.it_value.tv_nsec    = 1;
+
+	timerfd_settime (timer, 0, &spec, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Advances the adaptive schedule and arms the beacon timer
+///           to fire once when the schedule is due again. </summary>
+
+static void SendAdaptive (NDP_State* state)
+{
+	int send;
+	unsigned long long now = NDP_Time();
+	unsigned long long next = TrickleStep (state, now, &send);
+
+	if (send != 0)
+		SendBeacon (state);
+
+	struct itimerspec spec;
+	memset (&spec, 0, sizeof (spec));
+
+	// A zero value would disarm the timer
+	spec.it_value.tv_sec  =  (next - now) / 1000;
+	spec.it_value.tv_nsec = ((next - now) % 1000) * 1000000 + 1;
+
+	timerfd_settime (state->SendTimer, 0, &spec, NULL);
+
+	// A shard may have restarted the schedule before the timer was set
+	if (__atomic_load_n (&state->TrickleReset, __ATOMIC_SEQ_CST) != 0)
+		WakeSender (state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Handles an event raised by one of the sources of a state. </summary>
+
+static void HandleEvent (NDP_State* state, int source, int fd)
+{
+	uint64_t expired;
+
+	// Drain all pending beacons
+	if (source == SOURCE_SOCKET)
+	{
+		ReceiveFrames (state);
+
+		// Restart the schedule right away
+		if (state->TrickleReset != 0 && state->Silent == 0)
+			SendAdaptive (state);
+	}
+
+	// Send a beacon
+	if (source == SOURCE_SEND)
+	{
+		if (read (fd, &expired, sizeof (expired)) < 0)
+			return;
+
+		if (state->Adaptive != 0)
+			 SendAdaptive (state);
+		else SendBeacon   (state);
+	}
+
+	// Update the table
+	if (source == SOURCE_AGE)
+	{
+		if (read (fd, &expired, sizeof (expired)) < 0)
+			return;
+
+		AgeTable (state);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Thread that handles sending, receiving and aging for every
+///           state of an engine by waiting on their sockets and timers
+///           and on the stop event through a single epoll. </summary>
+
+static void* EngineThread (void* parameters)
+{
+	int i, n;
+
+	/// Retrieve the engine
+	NDP_Engine* engine = (NDP_Engine*) parameters;
+
+	/// Poll instead of blocking in the low latency profile
+	int timeout = -1;
+	for (i = 0; i < engine->Count; ++i)
+		if (engine->States[i]->LowLatency != 0)
+			timeout = 0;
+
+	/// Enter the event loop
+	struct epoll_event events[32];
+	while (1)
+	{
+		n = epoll_wait (engine->EpollID, events, 32, timeout);
+
+		// Receiving directly lets the kernel busy poll the device
+		if (timeout == 0)
+			for (i = 0; i < engine->Count; ++i)
+				if (engine->States[i]->LowLatency != 0)
+					ReceiveFrames (engine->States[i]);
+
+		for (i = 0; i < n; ++i)
+		{
+			uint64_t tag = events[i].data.u64;
+
+			// Shutdown was requested
+			if (tag == SOURCE_STOP)
+				return NULL;
+
+			NDP_State* state = engine->States[tag >> 2];
+			int source = (int) (tag & 3);
+
+			HandleEvent (state, source, source == SOURCE_SEND ?
+				state->SendTimer : state->AgeTimer);
+		}
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Closes the timer descriptors of a state. </summary>
+
+static void CloseTimers (NDP_State* state)
+{
+	if (state->SendTimer != -1) close (state->SendTimer);
+	if (state->AgeTimer  != -1) close (state->AgeTimer );
+
+	state->SendTimer = -1;
+	state->AgeTimer  = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the timers of a state and registers its sources. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int CreateTimers (NDP_State* state, int epoll, int index)
+{
+	int i;
+
+	state->SendTimer = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	state->AgeTimer  = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (state->SendTimer < 0 || state->AgeTimer < 0)
+		{ CloseTimers (state); return -1; }
+
+	// Register all descriptors for reading
+	int fds[3] =
+	{
+		state->SocketID,
+		state->SendTimer,
+		state->AgeTimer,
+	};
+
+	for (i = 0; i < 3; ++i)
+	{
+		struct epoll_event event;
+		event.events   = EPOLLIN;
+		event.data.u64 = ((uint64_t) index << 2) | i;
+
+		if (epoll_ctl (epoll, EPOLL_CTL_ADD, fds[i], &event) < 0)
+			{ CloseTimers (state); return -1; }
+	}
+
+	// Beacons are sent right away, the table is aged later
+	if (state->Silent == 0)
+		ArmTimer (state->SendTimer, state->Adaptive
+			!= 0 ? 0 : state->BeaconInterval);
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec  =  state->AgeInterval / 1000;
+	spec.it_interval.tv_nsec = (state->AgeInterval % 1000) * 1000000;
+	spec.it_value = spec.it_interval;
+	timerfd_settime (state->AgeTimer, 0, &spec, NULL);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Clears the table of a state whose threads have stopped. </summary>
+
+static void ResetState (NDP_State* state)
+{
+	unsigned long long now = NDP_Time();
+	unsigned int i;
+
+	StopShards (state);
+	pthread_mutex_destroy (&state->Mutex);
+
+	// Keep the neighbors for the next run
+	state->PersistTime = 0;
+	SavePersist (state, now);
+
+	// Neighbors leave along with the table
+	for (i = 0; i < state->Table.Capacity; ++i)
+		if (state->Table.Slots[i] != NULL)
+			EmitEvent (state, NDP_NEIGHBOR_DOWN,
+				&state->Table.Slots[i]->Addr, now);
+
+	// Clear neighbor table
+	TableClear (&state->Table);
+	state->PublishTime = 0;
+	PublishSnapshot (state, now);
+
+	// Restart the schedule with a beacon
+	state->TrickleInterval = 0;
+	state->TrickleSent = 0;
+	state->TrickleReset = 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Stress                                                                     //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Thread that floods spoofed beacons at a paced rate. </summary>
+
+static void* FloodThread (void* parameters)
+{
+	int i, n;
+
+	/// Retrieve the flooder
+	Flooder* flooder = (Flooder*) parameters;
+	NDP_State* state = flooder->State;
+
+	/// Create a batch of beacons
+	Beacon beacons[FLOOD_BATCH];
+	struct sockaddr_ll to;
+	struct iovec vectors[FLOOD_BATCH];
+	struct mmsghdr headers[FLOOD_BATCH];
+
+	memset (headers, 0, sizeof (headers));
+	for (i = 0; i < FLOOD_BATCH; ++i)
+	{
+		CreateBeacon (state, &beacons[i], &to);
+
+		// Spoofed beacons stay in the legacy format
+		vectors[i].iov_base = &beacons[i];
+		vectors[i].iov_len  = NDP_BEACON_HEADER_LEN;
+
+		headers[i].msg_hdr.msg_name    = &to;
+		headers[i].msg_hdr.msg_namelen = sizeof (to);
+		headers[i].msg_hdr.msg_iov     = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen  = 1;
+	}
+
+	/// Pace against the start time
+	unsigned long long start = NowNS();
+	unsigned long long sent  = 0;
+
+	/// Enter the flood loop
+	while (state->Stress != 0)
+	{
+		n = FLOOD_BATCH;
+
+		if (flooder->Rate > 0)
+		{
+			// Number of beacons that are due by now
+			unsigned long long due = (unsigned long long)
+				((NowNS() - start) * flooder->Rate / 1e9);
+
+			if (due <= sent)
+			{
+				// Sleep until the next beacon is due
+				unsigned long long wake = start + (unsigned long long)
+					((sent + 1) * 1e9 / flooder->Rate);
+
+				struct timespec ts;
+				ts.tv_sec  = wake / 1000000000ULL;
+				ts.tv_nsec = wake % 1000000000ULL;
+				clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+				continue;
+			}
+
+			if (due - sent < (unsigned long long) n)
+				n = (int) (due - sent);
+		}
+
+		// Spoof source addresses
+		for (i = 0; i < n; ++i)
+		{
+			unsigned long long r = NextRandom (&flooder->Seed);
+			beacons[i].SourceAddr.Data[3] = (unsigned char) (r      );
+			beacons[i].SourceAddr.Data[4] = (unsigned char) (r >>  8);
+			beacons[i].SourceAddr.Data[5] = (unsigned char) (r >> 16);
+		}
+
+		// Send the batch
+		n = sendmmsg (flooder->SocketID, headers, n, 0);
+		if (n > 0)
+		{
+			sent += n;
+			flooder->Sent += n;
+		}
+
+		// Back off when the device queue is full
+		else
+		{
+			COUNT (flooder->Errors, 1);
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Stops all sender threads and releases their sockets. </summary>
+
+static void StopFlood (NDP_State* state)
+{
+	Flooder* flooders = (Flooder*) state->Flood;
+	int i;
+
+	if (flooders == NULL)
+		return;
+
+	state->Stress = 0;
+	for (i = 0; i < state->FloodCount; ++i)
+	{
+		if (flooders[i].Thread != 0)
+			pthread_join (flooders[i].Thread, NULL);
+
+		if (flooders[i].SocketID != -1)
+			close (flooders[i].SocketID);
+
+		state->StressSent   += flooders[i].Sent;
+		state->StressErrors += flooders[i].Errors;
+	}
+
+	free (flooders);
+	state->Flood = NULL;
+	state->FloodCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Starts the sender threads, each with its own socket. </summary>
+/// <returns> Zero for success, negative one for failure. </returns>
+
+static int StartFlood (NDP_State* state)
+{
+	int i, count = state->StressThreads;
+
+	// Clamp the number of threads
+	if (count <= 0) count = 1;
+	if (count > FLOOD_THREADS_MAX)
+		count = FLOOD_THREADS_MAX;
+
+	Flooder* flooders = (Flooder*) aligned_alloc
+		(64, count * sizeof (Flooder));
+
+	if (flooders == NULL)
+		return -1;
+
+	memset (flooders, 0, count * sizeof (Flooder));
+	state->Flood = flooders;
+	state->FloodCount = count;
+	state->Stress = 1;
+
+	unsigned long long seed = NowNS() ^ (unsigned long long) (size_t) state;
+	for (i = 0; i < count; ++i)
+	{
+		flooders[i].State    = state;
+		flooders[i].SocketID = socket (PF_PACKET, SOCK_RAW, 0);
+		flooders[i].Seed     = NextRandom (&seed) | 1;
+		flooders[i].Rate     = (double) state->StressRate / count;
+			// A zero protocol socket never receives frames
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		// Bind the socket to the interface
+		struct sockaddr_ll sll;
+		memset (&sll, 0, sizeof (sll));
+
+		sll.sll_family  = AF_PACKET;
+		sll.sll_ifindex = state->IfIndex;
+
+		if (flooders[i].SocketID < 0 || bind (flooders[i].SocketID,
+			(struct sockaddr*) &sll, sizeof (sll)) < 0 ||
+			pthread_create (&flooders[i].Thread,
+			NULL, FloodThread, &flooders[i]) != 0)
+			{ StopFlood (state); return -1; }
+	}
+
+	return 0;
+}
+
+
+
+//----------------------------------------------------------------------------//
+// Core                                                                       //
+//----------------------------------------------------------------------------//
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Resets a state to its default configuration. </summary>
+/// <remarks> Call this before setting up the state for NDP_Create. </remarks>
+
+void NDP_Init (NDP_State* state)
+{
+	memset (state, 0, sizeof (NDP_State));
+
+	state->SocketID   = -1;
+	state->TableSize  = NDP_TABLE_LEN;
+	state->TableLimit = 0;
+	state->Mode       = NDP_MODE_EVENT;
+	state->BatchSize  = NDP_BATCH_LEN;
+	state->Shards     = 1;
+
+	state->BeaconInterval  = NDP_BEACON_INTERVAL;
+	state->AgeInterval     = NDP_AGE_INTERVAL;
+	state->Timeout         = NDP_TIMEOUT;
+	state->PublishInterval = NDP_PUBLISH_INTERVAL;
+	state->PersistInterval = NDP_PERSIST_INTERVAL;
+
+	state->TrickleMin        = NDP_TRICKLE_MIN;
+	state->TrickleMax        = NDP_TRICKLE_MAX;
+	state->TrickleRedundancy = NDP_TRICKLE_REDUNDANCY;
+
+	state->StressRate    = NDP_STRESS_RATE;
+	state->StressThreads = 1;
+
+	state->BusyPoll = NDP_BUSY_POLL;
+	state->SendCPU  = -1;
+	state->RecvCPU  = -1;
+
+	state->SendTimer  = -1;
+	state->AgeTimer   = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates an NDP state without a socket. </summary>
+/// <remarks> Beacons are applied with NDP_Inject and the table is aged
+///           with NDP_Advance, both driven by a clock starting at now
+///           which the caller controls. </remarks>
+
+void NDP_CreateOffline (NDP_State* state, unsigned long long now)
+{
+	/// Reset status variables
+	state->Active = 0;
+	state->Error  = 0;
+	state->Stress = 0;
+	state->SocketID = -1;
+
+	/// Validate the timing configuration
+	if (state->BeaconInterval <= 0) state->BeaconInterval = NDP_BEACON_INTERVAL;
+	if (state->AgeInterval    <= 0) state->AgeInterval    = NDP_AGE_INTERVAL;
+	if (state->Timeout        <= 0) state->Timeout        = NDP_TIMEOUT;
+	if (state->PublishInterval < 0) state->PublishInterval = 0;
+	if (state->PersistInterval < 0) state->PersistInterval = 0;
+
+	/// Validate the adaptive schedule
+	if (state->TrickleMin <= 0) state->TrickleMin = NDP_TRICKLE_MIN;
+	if (state->TrickleMax < state->TrickleMin) state->TrickleMax = state->TrickleMin;
+	if (state->TrickleRedundancy <= 0) state->TrickleRedundancy = NDP_TRICKLE_REDUNDANCY;
+	state->TrickleSeed = (NowNS() ^ (unsigned long long) (size_t) state) | 1;
+
+	/// Restarted senders start at a random sequence number
+	state->Sequence = (unsigned int) NextRandom (&state->TrickleSeed);
+
+	/// Allocate the neighbor table
+	if (TableCreate (&state->Table, state->TableSize > 0 ?
+		(unsigned int) state->TableSize : NDP_TABLE_LEN) < 0)
+		{ state->Error = NDP_ERROR_ALLOC_TABLE; return; }
+
+	state->Table.Wheel.Tick = now / state->AgeInterval;
+
+	/// Allocate the event ring
+	if (state->EventSize > 0 && state->Events == NULL && CreateEvents (state) < 0)
+		{ state->Error = NDP_ERROR_ALLOC_EVENTS; return; }
+
+	/// Open the capture file
+	if (state->CapturePath != NULL && state->Capture == NULL && CreateCapture (state) < 0)
+		{ state->Error = NDP_ERROR_OPEN_CAPTURE; return; }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates an NDP state given an interface. </summary>
+/// <remarks> The interface is defined in the state. </remarks>
+
+void NDP_Create (NDP_State* state)
+{
+	/// Allocate the table on the monotonic clock
+	NDP_CreateOffline (state, NDP_Time());
+	if (state->Error != NDP_ERROR_NONE)
+		return;
+
+	/// Create device level socket
+	state->SocketID = socket (PF_PACKET, SOCK_RAW, htons (ETH_P_ALL));
+		// PF_PACKET - Packet interface on device level
+		// SOCK_RAW  - Raw packets including link level header
+		// ETH_P_ALL - All frames will be received
+
+	if (state->SocketID < 0)
+		{ state->Error = NDP_ERROR_OPEN_SOCK; return; }
+
+	/// Fetch interface information
+	struct ifreq ifr;
+
+	// Copy the specified interface name
+	strcpy (ifr.ifr_name, state->Interface);
+
+	// Retrieve the interface index
+	if (ioctl (state->SocketID, SIOGIFINDEX, &ifr) < 0)
+		{ state->Error = NDP_ERROR_GET_IFINDEX; return; }
+
+	state->IfIndex = ifr.ifr_ifindex;
+
+	// Retrieve the hardware address
+	if (ioctl (state->SocketID, SIOCGIFHWADDR, &ifr) < 0)
+		{ state->Error = NDP_ERROR_GET_ADDRESS; return; }
+
+	memcpy (&state->Addr.Data, &ifr.ifr_hwaddr.sa_data, NDP_ADDR_LEN);
+
+	// Retrieve the maximum transmission unit
+	if (ioctl (state->SocketID, SIOCGIFMTU, &ifr) < 0)
+		{ state->Error = NDP_ERROR_GET_MTU; return; }
+
+	state->MTU = ifr.ifr_mtu;
+
+	/// Only let beacons through to userspace
+	struct sock_filter code[] =
+	{
+		// Check for correct protocol type
+		BPF_STMT (BPF_LD  | BPF_H   | BPF_ABS, 12),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, NDP_BEACON_TYPE, 0, 4),
+
+		// Check for correct beacon length
+		BPF_STMT (BPF_LD  | BPF_W   | BPF_LEN, 0),
+		BPF_JUMP (BPF_JMP | BPF_JGE | BPF_K, NDP_BEACON_HEADER_LEN, 0, 2),
+		BPF_JUMP (BPF_JMP | BPF_JGT | BPF_K, NDP_BEACON_MAX_LEN, 1, 0),
+
+		BPF_STMT (BPF_RET | BPF_K, NDP_BEACON_MAX_LEN),
+		BPF_STMT (BPF_RET | BPF_K, 0),
+	};
+
+	struct sock_fprog filter;
+	filter.len    = sizeof (code) / sizeof (code[0]);
+	filter.filter = code;
+
+	if (setsockopt (state->SocketID, SOL_SOCKET,
+		SO_ATTACH_FILTER, &filter, sizeof (filter)) < 0)
+		{ state->Error = NDP_ERROR_SET_FILTER; return; }
+
+	/// Add the promiscuous mode
+	if (state->Promisc != 0)
+	{
+		struct packet_mreq mr;
+		memset (&mr, 0, sizeof (mr));
+
+		mr.mr_ifindex = state->IfIndex;
+		mr.mr_type    = PACKET_MR_PROMISC;
+
+		if (setsockopt (state->SocketID, SOL_PACKET,
+			PACKET_ADD_MEMBERSHIP, (char*) &mr, sizeof (mr)) < 0)
+			{ state->Error = NDP_ERROR_ADD_PROM; return; }
+	}
+
+	/// Bind the socket to the interface
+	struct sockaddr_ll sll;
+	memset (&sll, 0, sizeof (sll));
+
+	sll.sll_family   = AF_PACKET;
+	sll.sll_ifindex  = state->IfIndex;
+	sll.sll_protocol = htons (ETH_P_ALL);
+
+	if (bind (state->SocketID, (struct sockaddr*) &sll, sizeof (sll)) < 0)
+		{ state->Error = NDP_ERROR_BIND_SOCK; return; }
+
+	/// Apply the low latency profile
+	if (state->LowLatency != 0 && SetLowLatency (state) < 0)
+		{ state->Error = NDP_ERROR_SET_LATENCY; return; }
+
+	/// Record kernel receive timestamps
+	int enable = 1;
+	if (state->Timestamps != 0 && setsockopt (state->SocketID,
+		SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof (enable)) < 0)
+		{ state->Error = NDP_ERROR_SET_LATENCY; return; }
+
+	/// Map the receive ring
+	if (state->Backend == NDP_RECV_RING && CreateRing (state) < 0)
+		{ state->Error = NDP_ERROR_CREATE_RING; return; }
+
+	/// Allocate the receive batch
+	if (state->Backend == NDP_RECV_BATCH && CreateBatch (state) < 0)
+		{ state->Error = NDP_ERROR_ALLOC_BATCH; return; }
+
+	/// Spread beacons over several shards
+	if (state->Shards > 1 && CreateShards (state) < 0)
+		{ state->Error = NDP_ERROR_JOIN_FANOUT; return; }
+
+	/// Reload the neighbors of the previous run
+	if (state->PersistPath != NULL && state->Persist == NULL && OpenPersist (state) < 0)
+		{ state->Error = NDP_ERROR_OPEN_PERSIST; return; }
+
+	/// Export the table to shared memory
+	if (state->ExportName != NULL && state->Export == NULL && OpenExport (state) < 0)
+		{ state->Error = NDP_ERROR_OPEN_EXPORT; return; }
+
+	/// Discard frames queued before the filter was attached
+	DrainSocket (state->SocketID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Destroys the specified NDP state. </summary>
+/// <remarks> This function makes a call to NDP_Stop. </remarks>
+
+void NDP_Destroy (NDP_State* state)
+{
+	// Close the socket
+	if (state->SocketID != -1)
+	{
+		NDP_Stop (state);
+
+		if (state->Ring != NULL)
+			munmap (state->Ring, RING_BLOCK_SIZE * RING_BLOCK_NR);
+
+		close (state->SocketID);
+		state->SocketID = -1;
+		state->Ring = NULL;
+	}
+
+	// Release the receive batch
+	DestroyBatch (state);
+
+	// Release the shards
+	DestroyShards (state);
+
+	// Release the event ring
+	free (state->Events);
+	state->Events = NULL;
+
+	// Close the capture file
+	FlushCapture (state);
+	if (state->Capture != NULL)
+		fclose ((FILE*) state->Capture);
+	state->Capture = NULL;
+
+	free (state->CaptureQueue);
+	state->CaptureQueue = NULL;
+	state->CaptureSize  = 0;
+
+	// Close the table file
+	DestroyPersist (state);
+
+	// Remove the shared memory segment
+	DestroyExport (state);
+
+	// Release the neighbor table
+	TableDestroy (&state->Table);
+	DestroySnapshots (state);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Creates the threads and starts the NDP protocol. </summary>
+
+void NDP_Start (NDP_State* state)
+{
+	// Ensure non-active and no errors
+	if (state->Error == 0 && state->Active == 0)
+	{
+		// Run on a private engine
+		if (state->Mode == NDP_MODE_EVENT)
+		{
+			NDP_Engine* engine = (NDP_Engine*)
+				calloc (1, sizeof (NDP_Engine));
+
+			if (engine == NULL)
+				{ state->Error = NDP_ERROR_CREATE_LOOP; return; }
+
+			engine->Owner = state;
+			NDP_EngineStart (engine, &engine->Owner, 1);
+
+			if (engine->Error != 0)
+			{
+				state->Error = engine->Error;
+				free (engine);
+			}
+
+			return;
+		}
+
+		// Create threads
+		state->Active = 1;
+		pthread_mutex_init (&state->Mutex, NULL);
+
+		if (CreateThread (&state->SendThread, state->
+			SendCPU, state->Priority, SendThread, state) != 0)
+		{
+			state->Active = 0;
+			pthread_mutex_destroy (&state->Mutex);
+			state->Error = NDP_ERROR_START_THREAD;
+			return;
+		}
+
+		if (CreateThread (&state->RecvThread, state->
+			RecvCPU, state->Priority, RecvThread, state) != 0)
+		{
+			state->Active = 0;
+			pthread_join (state->SendThread, NULL);
+			pthread_mutex_destroy (&state->Mutex);
+			state->Error = NDP_ERROR_START_THREAD;
+			return;
+		}
+
+		StartShards (state);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Stops the NDP protocol and destroys the threads. </summary>
+/// <remarks> States started with NDP_EngineStart are stopped together
+///           through NDP_EngineStop instead. </remarks>
+
+void NDP_Stop (NDP_State* state)
+{
+	// Ensure non-active
+	if (state->Active != 0)
+	{
+		// Stop the private engine
+		if (state->Engine != NULL)
+		{
+			NDP_Engine* engine = state->Engine;
+			if (engine->Owner == state)
+			{
+				NDP_EngineStop (engine);
+				free (engine);
+			}
+
+			return;
+		}
+
+		// Stop stress testing
+		StopFlood (state);
+
+		// Join threads
+		state->Active = 0;
+		pthread_join (state->SendThread, NULL);
+		pthread_join (state->RecvThread, NULL);
+		ResetState (state);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Runs several states from a single event loop thread. </summary>
+/// <remarks> Each state must have been created with NDP_Create and the
+///           array of states must remain valid until NDP_EngineStop. </remarks>
+
+void NDP_EngineStart (NDP_Engine* engine, NDP_State** states, int count)
+{
+	int i, ready = 0;
+
+	engine->Error     = 0;
+	engine->States    = states;
+	engine->Count     = count;
+	engine->Active    = 0;
+	engine->EpollID   = epoll_create1 (EPOLL_CLOEXEC);
+	engine->StopEvent = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	struct epoll_event event;
+	event.events   = EPOLLIN;
+	event.data.u64 = SOURCE_STOP;
+
+	if (engine->EpollID < 0 || engine->StopEvent < 0 || epoll_ctl
+		(engine->EpollID, EPOLL_CTL_ADD, engine->StopEvent, &event) < 0)
+		engine->Error = NDP_ERROR_CREATE_LOOP;
+
+	// Register the sources of every state
+	for (i = 0; i < count && engine->Error == 0; ++i, ++ready)
+	{
+		if (states[i]->Error != 0 || states[i]->Active != 0)
+			engine->Error = states[i]->Error != 0 ?
+				states[i]->Error : NDP_ERROR_CREATE_LOOP;
+
+		else if (CreateTimers (states[i], engine->EpollID, i) < 0)
+			engine->Error = states[i]->Error = NDP_ERROR_CREATE_LOOP;
+	}
+
+	for (i = 0; i < count && engine->Error == 0; ++i)
+	{
+		states[i]->Engine = engine;
+		states[i]->Active = 1;
+		pthread_mutex_init (&states[i]->Mutex, NULL);
+	}
+
+	// The thread receives for the first state
+	if (engine->Error == 0 && CreateThread (&engine->Thread,
+		count > 0 ? states[0]->RecvCPU   : -1,
+		count > 0 ? states[0]->Priority  :  0, EngineThread, engine) != 0)
+		engine->Error = NDP_ERROR_START_THREAD;
+
+	if (engine->Error == 0)
+	{
+		engine->Active = 1;
+		for (i = 0; i < count; ++i)
+			StartShards (states[i]);
+
+		return;
+	}
+
+	// Undo everything on failure
+	for (i = 0; i < count; ++i)
+	{
+		if (i < ready)
+			CloseTimers (states[i]);
+
+		if (states[i]->Engine == engine)
+		{
+			states[i]->Engine = NULL;
+			states[i]->Active = 0;
+			pthread_mutex_destroy (&states[i]->Mutex);
+		}
+	}
+
+	if (engine->EpollID   >= 0) close (engine->EpollID  );
+	if (engine->StopEvent >= 0) close (engine->StopEvent);
+
+	if (engine->Error == 0)
+		engine->Error = NDP_ERROR_CREATE_LOOP;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Stops an engine along with all of its states. </summary>
+
+void NDP_EngineStop (NDP_Engine* engine)
+{
+	int i;
+
+	if (engine->Active == 0)
+		return;
+
+	// Stop stress testing
+	for (i = 0; i < engine->Count; ++i)
+		StopFlood (engine->States[i]);
+
+	// Wake up the event loop
+	uint64_t stop = 1;
+	write (engine->StopEvent, &stop, sizeof (stop));
+	pthread_join (engine->Thread, NULL);
+
+	for (i = 0; i < engine->Count; ++i)
+	{
+		NDP_State* state = engine->States[i];
+		state->Engine = NULL;
+		state->Active = 0;
+
+		// Shards may wake the send timer until they stop
+		ResetState  (state);
+		CloseTimers (state);
+	}
+
+	close (engine->EpollID  );
+	close (engine->StopEvent);
+	engine->Active = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Locks access to the neighbor table. </summary>
+
+void NDP_Lock (NDP_State* state)
+{
+	if (state->Active != 0)
+		pthread_mutex_lock (&state->Mutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Releases access to the neighbor table. </summary>
+
+void NDP_Unlock (NDP_State* state)
+{
+	if (state->Active != 0)
+		pthread_mutex_unlock (&state->Mutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the latest published snapshot of the table. </summary>
+/// <remarks> Never blocks the writer, every snapshot acquired must be
+///           returned with NDP_ReleaseSnapshot when finished. </remarks>
+
+const NDP_Snapshot* NDP_AcquireSnapshot (NDP_State* state)
+{
+	while (1)
+	{
+		int current = __atomic_load_n (&state->Published, __ATOMIC_SEQ_CST);
+		NDP_Snapshot* snapshot = &state->Snapshots[current];
+
+		// Register as a reader and make sure it's still current
+		__atomic_add_fetch (&snapshot->Readers, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n (&state->Published, __ATOMIC_SEQ_CST) == current)
+			return snapshot;
+
+		__atomic_sub_fetch (&snapshot->Readers, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns a snapshot obtained with NDP_AcquireSnapshot. </summary>
+
+void NDP_ReleaseSnapshot (const NDP_Snapshot* snapshot)
+{
+	__atomic_sub_fetch (&((NDP_Snapshot*) snapshot)->Readers, 1, __ATOMIC_SEQ_CST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Acquires the latest snapshots of every shard of a state. </summary>
+/// <remarks> Every view acquired must be returned with NDP_ReleaseView. </remarks>
+
+void NDP_AcquireView (NDP_State* state, NDP_View* view)
+{
+	int i;
+
+	view->Shards[0] = NDP_AcquireSnapshot (state);
+	view->Count = 1 + state->WorkerCount;
+	view->Total = view->Shards[0]->Count;
+
+	for (i = 0; i < state->WorkerCount; ++i)
+	{
+		view->Shards[i + 1] = NDP_AcquireSnapshot (&state->Workers[i]);
+		view->Total += view->Shards[i + 1]->Count;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns a view obtained with NDP_AcquireView. </summary>
+
+void NDP_ReleaseView (NDP_View* view)
+{
+	int i;
+	for (i = 0; i < view->Count; ++i)
+		NDP_ReleaseSnapshot (view->Shards[i]);
+
+	view->Count = 0;
+	view->Total = 0;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Processes a beacon that has arrived. </summary>
+/// <summary> Performs all pending work of a state from a thread or
+///           event loop owned by the caller instead of NDP_Start. </summary>
+/// <remarks> Call this whenever SocketID becomes readable and at the
+///           latest when the returned time has passed. The state must
+///           not be started, receive shards are not served. </remarks>
+/// <returns> Milliseconds until this must be called again. </returns>
 
-static void ReceiveBeacon (NDP_State* state, const Beacon* beacon)
+int NDP_Process (NDP_State* state)
 {
-	int i, free = -1;
-	for (i = 0; i < NDP_TABLE_LEN; ++i)
+	unsigned long long now = NDP_Time();
+
+	// Drain all pending beacons
+	ReceiveFrames (state);
+
+	// Send a beacon adaptively
+	if (state->Adaptive != 0)
 	{
-		// Track free entry in case we need it
-		if (state->Table[i] == NULL)
-			free = i;
+		if (now >= state->NextBeacon || state->TrickleReset != 0)
+		{
+			int send;
+			state->NextBeacon = TrickleStep (state, now, &send);
 
-		// Compare the address with current entry
-		else if (memcmp (&state->Table[i]->Addr,
-			&beacon->SourceAddr, NDP_ADDR_LEN) == 0)
-			{
-				state->Table[i]->Arrived = 1;
-				return;
-			}
+			if (send != 0 && state->Silent == 0)
+				SendBeacon (state);
+		}
 	}
 
-	// No entries found, attempt to add
-	if (free != -1)
+	// Send a beacon
+	else if (now >= state->NextBeacon)
 	{
-		// Allocate and create an entry
-		state->Table[free] = (NDP_Neighbor*)
-			malloc (sizeof (NDP_Neighbor));
+		if (state->Silent == 0)
+			SendBeacon (state);
 
-		state->Table[free]->Addr = beacon->SourceAddr;
-		state->Table[free]->Arrived  =  1;
-		state->Table[free]->Recorded = -1;
+		state->NextBeacon = now + state->BeaconInterval;
 	}
+
+	// Update the table
+	if (now >= state->NextAge)
+	{
+		AgeTable (state);
+		state->NextAge = now + state->AgeInterval;
+	}
+
+	return (int) ((state->NextBeacon < state->NextAge ?
+		state->NextBeacon : state->NextAge) - now);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Updates the neighbor table. </summary>
+/// <summary> Returns the version the library was built with. </summary>
+/// <remarks> Compare with NDP_VERSION to detect a mismatched header. </remarks>
 
-static void UpdateTable (NDP_State* state)
+unsigned int NDP_Version (void)
 {
-	int i;
-	for (i = 0; i < NDP_TABLE_LEN; ++i)
-		if (state->Table[i] != NULL)
-		{
-			// Check if we recieved a beacon
-			if (state->Table[i]->Arrived == 0)
-			{
-				// Remove out-of-range neighbors
-				if (++state->Table[i]->Recorded >= NDP_MAX_RECORD)
-				{
-					// Deallocate and remove entry
-					free (state->Table[i]);
-					state->Table[i] = NULL;
-				}
-			}
-
-			else
-			{
-				// Reset arrival state
-				state->Table[i]->Arrived  = 0;
-				state->Table[i]->Recorded = 0;
-			}
-		}
+	return NDP_VERSION;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Applies a beacon from the given source at a given time. </summary>
+/// <remarks> The state must not be running or the table must be locked
+///           with NDP_Lock, now must not go backwards. </remarks>
 
+void NDP_Inject (NDP_State* state, const NDP_Addr* source, unsigned long long now)
+{
+	Beacon beacon;
+	memset (&beacon, 0, sizeof (beacon));
 
-//----------------------------------------------------------------------------//
-// Threading                                                                  //
-//----------------------------------------------------------------------------//
+	beacon.SourceAddr = *source;
+	beacon.Type = htons (NDP_BEACON_TYPE);
+	ReceiveBeacon (state, &beacon, NDP_BEACON_HEADER_LEN, now, now * 1000000ULL);
+
+	// The caller may hold the lock of a running state, whose
+	// next received batch then writes the capture
+	if (state->Active == 0)
+		FlushCapture (state);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Thread that handles sending beacon packets. </summary>
+/// <summary> Expires neighbors and publishes the table at a given time. </summary>
+/// <remarks> The state must not be running or the table must be locked
+///           with NDP_Lock, now must not go backwards. </remarks>
 
-static void* SendThread (void* parameters)
+void NDP_Advance (NDP_State* state, unsigned long long now)
 {
-	int i;
-
-	/// Retrieve the NDP state
-	NDP_State* state = (NDP_State*) parameters;
+	UpdateTable (state, now);
+	PublishSnapshot (state, now);
+}
 
-	/// Create a beacon
-	Beacon beacon;
-	for (i = 0; i < NDP_ADDR_LEN; ++i)
-		beacon.TargetAddr.Data[i] = 255;
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Feeds the beacons of a pcap file through the table. </summary>
+/// <remarks> The state must be created with NDP_CreateOffline. Capture
+///           timestamps drive a simulated clock which ages the table,
+///           paced replays also wait for the recorded time to pass. </remarks>
+/// <returns> Beacons replayed or negative one for failure. </returns>
 
-	beacon.SourceAddr = state->Addr;
-	beacon.Type       = htons (IP_TYPE);
+long long NDP_Replay (NDP_State* state, const char* path, int paced)
+{
+	unsigned long long first = 0, now = 0, start = NowNS();
+	long long count = 0;
+	unsigned char frame[65536];
+	PcapHeader header;
+	PcapRecord record;
 
-	/// Set the destination address
-	struct sockaddr_ll to;
-	memset (&to, 0, sizeof (to));
-	int tolen = sizeof (to);
+	FILE* file = fopen (path, "rb");
+	if (file == NULL)
+		return -1;
 
-	to.sll_family  = AF_PACKET;
-	to.sll_pkttype = PACKET_BROADCAST;
-	to.sll_ifindex = state->IfIndex;
+	if (fread (&header, sizeof (header), 1, file) != 1)
+		{ fclose (file); return -1; }
 
-	to.sll_halen = NDP_ADDR_LEN;
-	for (i = 0; i < NDP_ADDR_LEN; ++i)
-		to.sll_addr[i] = 255;
+	// Support files written in either byte order
+	char swap = header.Magic == __builtin_bswap32 (PCAP_MAGIC_US) ||
+				header.Magic == __builtin_bswap32 (PCAP_MAGIC_NS);
+	uint32_t magic = swap ? __builtin_bswap32 (header.Magic) : header.Magic;
 
-	/// Broadcast periodically
-	unsigned int elapsed = 4000000;
+	if ((magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) ||
+		(swap ? __builtin_bswap32 (header.LinkType) :
+		header.LinkType) != PCAP_ETHERNET)
+		{ fclose (file); return -1; }
 
-	/// Enter the send loop
-	while (state->Active)
+	while (fread (&record, sizeof (record), 1, file) == 1)
 	{
-		// Use stress test mode
-		if (state->Stress != 0)
+		if (swap)
 		{
-			// Spoof source address
-			beacon.SourceAddr.Data[3] = (unsigned char) (rand() % 256);
-			beacon.SourceAddr.Data[4] = (unsigned char) (rand() % 256);
-			beacon.SourceAddr.Data[5] = (unsigned char) (rand() % 256);
+			record.Seconds  = __builtin_bswap32 (record.Seconds );
+			record.Fraction = __builtin_bswap32 (record.Fraction);
+			record.Length   = __builtin_bswap32 (record.Length  );
+		}
 
-			// Send beacon
-			sendto (state->SocketID, &beacon, sizeof
-				(beacon), 0, (struct sockaddr*) &to, tolen);
+		if (record.Length > sizeof (frame) ||
+			fread (frame, 1, record.Length, file) != record.Length)
+			break;
 
-			// Reset source address
-			beacon.SourceAddr = state->Addr;
+		// Convert the timestamp to milliseconds
+		now = record.Seconds * 1000ULL + (magic == PCAP_MAGIC_NS ?
+			record.Fraction / 1000000 : record.Fraction / 1000);
 
-			usleep (10000);
-			continue;
-		}
+		// The empty table starts on the first timestamp
+		if (count == 0)
+			{ first = now; UpdateTable (state, now); }
 
-		// Send normally
-		if (elapsed > 3000000)
+		// Wait for the recorded time to pass
+		if (paced)
 		{
-			// Send beacon
-			sendto (state->SocketID, &beacon, sizeof
-				(beacon), 0, (struct sockaddr*) &to, tolen);
+			unsigned long long wake = start + (now - first) * 1000000ULL;
+			struct timespec ts;
+			ts.tv_sec  = wake / 1000000000ULL;
+			ts.tv_nsec = wake % 1000000000ULL;
+			clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
 
-			// Reset timer
-			elapsed = 0;
+		NDP_Advance (state, now);
+		COUNT (state->RecvStats.FramesReceived, 1);
+
+		// Apply the beacon like a received one
+		const Beacon* beacon = (const Beacon*) frame;
+		if (record.Length >= NDP_BEACON_HEADER_LEN &&
+			beacon->Type == htons (NDP_BEACON_TYPE))
+		{
+			ReceiveBeacon (state, beacon, record.Length, now,
+				record.Seconds * 1000000000ULL + (magic == PCAP_MAGIC_NS ?
+				record.Fraction : record.Fraction * 1000ULL));
+			FlushCapture (state);
 		}
 
-		// Sleep for 100 ms
-		usleep (10000);
-		elapsed += 10000;
+		else COUNT (state->RecvStats.FramesFiltered, 1);
+		++count;
 	}
 
-	return NULL;
+	// Publish the final table regardless of the interval
+	if (count > 0)
+	{
+		state->PublishTime = 0;
+		NDP_Advance (state, now);
+	}
+
+	fclose (file);
+	return count;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Thread that handles receiving beacon packets. </summary>
+/// <summary> Sums the statistics of every thread serving a state. </summary>
+/// <remarks> Counters keep running while they are read, so the totals
+///           may be slightly out of step with each other. </remarks>
 
-static void* RecvThread (void* parameters)
+void NDP_GetStats (NDP_State* state, NDP_Stats* stats)
 {
-	/// Retrieve the NDP state
-	NDP_State* state = (NDP_State*) parameters;
-
-	/// Create a beacon
-	Beacon beacon;
-
-	/// Set the source address
-	struct sockaddr_ll from;
-	memset (&from, 0, sizeof (from));
-	socklen_t fromlen;
+	const Flooder* flooders = (const Flooder*) state->Flood;
+	NDP_Stats shard;
+	int i;
 
-	/// Update the table periodically
-	unsigned int elapsed = 0;
+	memset (stats, 0, sizeof (NDP_Stats));
+	AddStats (stats, &state->RecvStats);
+	AddStats (stats, &state->SendStats);
 
-	/// Enter the receive loop
-	while (state->Active)
+	// Include every receive shard
+	for (i = 0; i < state->WorkerCount; ++i)
 	{
-		// Reset network values
-		fromlen = sizeof (from);
-		memset (&beacon, 0, sizeof (beacon));
-
-		// Non blocking receive beacon
-		recvfrom (state->SocketID, &beacon, sizeof (beacon),
-			MSG_DONTWAIT, (struct sockaddr*) &from, &fromlen);
-
-		// Check for correct protocol type
-		if (beacon.Type == htons (IP_TYPE))
-		{
-			NDP_Lock (state);
-			ReceiveBeacon (state, &beacon);
-			NDP_Unlock (state);
-		}
-
-		// Update the table
-		if (elapsed > 5000000)
-		{
-			NDP_Lock (state);
-			UpdateTable (state);
-			NDP_Unlock (state);
-
-			// Reset timer
-			elapsed = 0;
-		}
-
-		// Sleep for 100 ms
-		usleep (9000);
-		elapsed += 9000;
+		NDP_GetStats (&state->Workers[i], &shard);
+		AddStats (stats, &shard);
 	}
 
-	return NULL;
+	// Include the stress testing senders
+	stats->SendErrors += state->StressErrors;
+	for (i = 0; i < state->FloodCount; ++i)
+		stats->SendErrors += __atomic_load_n
+			(&flooders[i].Errors, __ATOMIC_RELAXED);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Adds the statistics of a state to a running total. </summary>
+/// <remarks> Used to combine the statistics of several interfaces. </remarks>
 
-
-//----------------------------------------------------------------------------//
-// Core                                                                       //
-//----------------------------------------------------------------------------//
+void NDP_AddStats (NDP_Stats* total, const NDP_Stats* stats)
+{
+	AddStats (total, stats);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Creates an NDP state given an interface. </summary>
-/// <remarks> The interface is defined in the state. </remarks>
+/// <summary> Returns the upper bound of the bucket holding a percentile. </summary>
+/// <remarks> P is a share between zero and one of one of the histograms
+///           of NDP_Stats. </remarks>
+/// <returns> Nanoseconds, or zero when the histogram is empty. </returns>
 
-void NDP_Create (NDP_State* state)
+unsigned long long NDP_Percentile (const unsigned long long* histogram, double p)
 {
-	/// Reset status variables
-	state->Active = 0;
-	state->Error  = 0;
-	state->Stress = 0;
-
-	memset (state->Table, 0, NDP_TABLE_LEN * sizeof (NDP_Neighbor*));
+	unsigned long long total = 0, seen = 0;
+	int i;
 
-	/// Create device level socket
-	state->SocketID = socket (PF_PACKET, SOCK_RAW, htons (ETH_P_ALL));
-		// PF_PACKET - Packet interface on device level
-		// SOCK_RAW  - Raw packets including link level header
-		// ETH_P_ALL - All frames will be received
+	for (i = 0; i < NDP_HISTOGRAM_LEN; ++i)
+		total += histogram[i];
 
-	if (state->SocketID < 0)
-		{ state->Error = NDP_ERROR_OPEN_SOCK; return; }
+	for (i = 0; i < NDP_HISTOGRAM_LEN; ++i)
+	{
+		seen += histogram[i];
+		if (total > 0 && seen >= total * p)
+			return 1ULL << (i + 1);
+	}
 
-	/// Fetch interface information
-	struct ifreq ifr;
+	return 0;
+}
 
-	// Copy the specified interface name
-	strcpy (ifr.ifr_name, state->Interface);
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Removes up to count of the oldest neighbor events. </summary>
+/// <remarks> Only a single thread may drain the events of a state. </remarks>
+/// <returns> Number of events stored in the array. </returns>
 
-	// Retrieve the interface index
-	if (ioctl (state->SocketID, SIOGIFINDEX, &ifr) < 0)
-		{ state->Error = NDP_ERROR_GET_IFINDEX; return; }
+int NDP_PollEvents (NDP_State* state, NDP_Event* events, int count)
+{
+	EventRing* ring = (EventRing*) state->Events;
+	int i;
 
-	state->IfIndex = ifr.ifr_ifindex;
+	if (ring == NULL)
+		return 0;
 
-	// Retrieve the hardware address
-	if (ioctl (state->SocketID, SIOCGIFHWADDR, &ifr) < 0)
-		{ state->Error = NDP_ERROR_GET_ADDRESS; return; }
+	for (i = 0; i < count; ++i)
+	{
+		EventCell* cell = &ring->Cells[ring->Tail & ring->Mask];
 
-	memcpy (&state->Addr.Data, &ifr.ifr_hwaddr.sa_data, NDP_ADDR_LEN);
+		// Stop at the first cell not yet published
+		if (__atomic_load_n (&cell->Sequence,
+			__ATOMIC_ACQUIRE) != ring->Tail + 1)
+			break;
 
-	// Retrieve the maximum transmission unit
-	if (ioctl (state->SocketID, SIOCGIFMTU, &ifr) < 0)
-		{ state->Error = NDP_ERROR_GET_MTU; return; }
+		events[i] = cell->Event;
 
-	state->MTU = ifr.ifr_mtu;
+		// Free the cell for the next lap
+		__atomic_store_n (&cell->Sequence,
+			ring->Tail + ring->Mask + 1, __ATOMIC_RELEASE);
+		++ring->Tail;
+	}
 
-	/// Add the promiscuous mode
-	struct packet_mreq mr;
-	memset (&mr, 0, sizeof (mr));
+	return i;
+}
 
-	mr.mr_ifindex = state->IfIndex;
-	mr.mr_type    = PACKET_MR_PROMISC;
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the number of events lost to a full ring. </summary>
 
-	if (setsockopt (state->SocketID, SOL_PACKET,
-		PACKET_ADD_MEMBERSHIP, (char*) &mr, sizeof (mr)) < 0)
-		{ state->Error = NDP_ERROR_ADD_PROM; return; }
+unsigned long long NDP_EventDrops (const NDP_State* state)
+{
+	const EventRing* ring = (const EventRing*) state->Events;
+	return ring == NULL ? 0 : __atomic_load_n (&ring->Drops, __ATOMIC_RELAXED);
+}
 
-	/// Bind the socket to the interface
-	struct sockaddr_ll sll;
-	memset (&sll, 0, sizeof (sll));
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Starts or stops flooding spoofed beacons. </summary>
+/// <remarks> Uses StressThreads senders paced to StressRate beacons
+///           per second in total, or as fast as possible if zero. </remarks>
 
-	sll.sll_family   = AF_PACKET;
-	sll.sll_ifindex  = state->IfIndex;
-	sll.sll_protocol = htons (ETH_P_ALL);
+void NDP_SetStress (NDP_State* state, int enable)
+{
+	if (enable != 0 && state->Flood == NULL && state->Active != 0)
+		StartFlood (state);
 
-	if (bind (state->SocketID, (struct sockaddr*) &sll, sizeof (sll)) < 0)
-		{ state->Error = NDP_ERROR_BIND_SOCK; return; }
+	if (enable == 0)
+		StopFlood (state);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Destroys the specified NDP state. </summary>
-/// <remarks> This function makes a call to NDP_Stop. </remarks>
+/// <summary> Returns the number of spoofed beacons sent so far. </summary>
 
-void NDP_Destroy (NDP_State* state)
+unsigned long long NDP_StressSent (const NDP_State* state)
 {
-	// Close the socket
-	if (state->SocketID != -1)
-	{
-		NDP_Stop (state);
-		close (state->SocketID);
-	}
+	const Flooder* flooders = (const Flooder*) state->Flood;
+	unsigned long long sent = state->StressSent;
+	int i;
+
+	for (i = 0; i < state->FloodCount; ++i)
+		sent += flooders[i].Sent;
+
+	return sent;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Creates the threads and starts the NDP protocol. </summary>
+/// <summary> Maps the segments exported by a state for reading. </summary>
+/// <remarks> Name is the ExportName of the state. Use NDP_ReadExport
+///           to copy the table and NDP_CloseReader when done. </remarks>
+/// <returns> Zero for success, negative one for failure. </returns>
 
-void NDP_Start (NDP_State* state)
+int NDP_OpenReader (NDP_Reader* reader, const char* name)
 {
-	// Ensure non-active and no errors
-	if (state->Error == 0 && state->Active == 0)
+	char shard[NAME_MAX];
+	int i, count = 1;
+
+	memset (reader, 0, sizeof (NDP_Reader));
+
+	for (i = 0; i < count; ++i)
 	{
-		// Create threads
-		state->Active = 1;
-		pthread_mutex_init (&state->Mutex, NULL);
-		pthread_create (&state->SendThread, NULL, SendThread, state);
-		pthread_create (&state->RecvThread, NULL, RecvThread, state);
+		ShardName (name, i, shard, sizeof (shard));
+		int file = shm_open (shard, O_RDONLY | O_CLOEXEC, 0);
+		if (file < 0)
+			goto fail;
+
+		struct stat info;
+		void* map = MAP_FAILED;
+
+		if (fstat (file, &info) == 0 && info.st_size >= (off_t) sizeof (NDP_Export))
+			map = mmap (NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, file, 0);
+
+		close (file);
+		if (map == MAP_FAILED)
+			goto fail;
+
+		const NDP_Export* segment = (const NDP_Export*) map;
+		reader->Segments[i] = segment;
+		reader->Lengths [i] = (unsigned long) info.st_size;
+		reader->Shards = i + 1;
+
+		if (__atomic_load_n (&segment->Magic, __ATOMIC_ACQUIRE) !=
+			NDP_EXPORT_MAGIC || segment->Version != NDP_EXPORT_VERSION)
+			goto fail;
+
+		// The first segment tells how many there are
+		if (i == 0)
+		{
+			count = segment->Shards;
+			if (count < 1) count = 1;
+			if (count > NDP_SHARDS_MAX) count = NDP_SHARDS_MAX;
+
+			memcpy (reader->Interface, segment->Interface, NDP_IFNAME_LEN);
+			reader->IfIndex = segment->IfIndex;
+			reader->MTU     = segment->MTU;
+			reader->Addr    = segment->Addr;
+			reader->Timeout = segment->Timeout;
+		}
 	}
+
+	return 0;
+
+fail:
+	NDP_CloseReader (reader);
+	return -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Stops the NDP protocol and destroys the threads. </summary>
+/// <summary> Copies the neighbors and counters of every shard. </summary>
+/// <remarks> Each shard is copied consistently without locking, a copy
+///           torn by the writer is simply repeated. No system calls are
+///           made unless a segment grew since the last read. </remarks>
+/// <returns> Zero for success, negative one once the state is gone,
+///           in which case the reader must be opened again. </returns>
 
-void NDP_Stop (NDP_State* state)
+int NDP_ReadExport (NDP_Reader* reader)
 {
-	// Ensure non-active
-	if (state->Active != 0)
+	unsigned long long time = 0;
+	unsigned int total = 0;
+	NDP_Stats stats;
+	int i;
+
+	memset (&stats, 0, sizeof (NDP_Stats));
+
+	for (i = 0; i < reader->Shards; ++i)
 	{
-		int i;
+		while (1)
+		{
+			const NDP_Export* segment = reader->Segments[i];
+			unsigned int sequence = __atomic_load_n
+				(&segment->Sequence, __ATOMIC_ACQUIRE);
 
-		// Join threads
-		state->Active = 0;
-		pthread_join (state->SendThread, NULL);
-		pthread_join (state->RecvThread, NULL);
-		pthread_mutex_destroy (&state->Mutex);
+			if (segment->Closed != 0)
+				return -1;
+
+			if ((sequence & 1) != 0)
+				{ ++reader->Retries; continue; }
 
-		// Clear neighbor table
-		for (i = 0; i < NDP_TABLE_LEN; ++i)
-			if (state->Table[i] != NULL)
+			unsigned int size  = segment->Size;
+			unsigned int count = segment->Count;
+			size_t length = sizeof (NDP_Export) + size * sizeof (NDP_Entry);
+
+			// Follow the writer when the segment grew
+			if (length > reader->Lengths[i])
 			{
-				free (state->Table[i]);
-				state->Table[i] = NULL;
+				void* map = mremap ((void*) segment,
+					reader->Lengths[i], length, MREMAP_MAYMOVE);
+
+				if (map == MAP_FAILED)
+					return -1;
+
+				reader->Segments[i] = (const NDP_Export*) map;
+				reader->Lengths [i] = length;
+				continue;
 			}
-	}
-}
 
-////////////////////////////////////////////////////////////////////////////////
-/// <summary> Locks access to the neighbor table. </summary>
+			if (count > size)
+				{ ++reader->Retries; continue; }
 
-void NDP_Lock (NDP_State* state)
-{
-	if (state->Active != 0)
-		pthread_mutex_lock (&state->Mutex);
+			// Make room for every neighbor copied so far
+			if (total + count > reader->Size)
+			{
+				NDP_Entry* entries = (NDP_Entry*) realloc (reader->
+					Entries, (total + size) * sizeof (NDP_Entry));
+
+				if (entries == NULL)
+					return -1;
+
+				reader->Entries = entries;
+				reader->Size = total + size;
+			}
+
+			memcpy (reader->Entries + total,
+				segment->Entries, count * sizeof (NDP_Entry));
+
+			NDP_Stats copy = segment->Stats;
+			unsigned long long published = segment->Time;
+
+			// Keep the copy only if the writer stayed away
+			__atomic_thread_fence (__ATOMIC_ACQUIRE);
+			if (__atomic_load_n (&segment->Sequence, __ATOMIC_RELAXED) != sequence)
+				{ ++reader->Retries; continue; }
+
+			AddStats (&stats, &copy);
+			if (time < published)
+				time = published;
+
+			total += count;
+			break;
+		}
+	}
+
+	reader->Count = total;
+	reader->Stats = stats;
+	reader->Time  = time;
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Releases access to the neighbor table. </summary>
+/// <summary> Unmaps the segments and releases the copied entries. </summary>
 
-void NDP_Unlock (NDP_State* state)
+void NDP_CloseReader (NDP_Reader* reader)
 {
-	if (state->Active != 0)
-		pthread_mutex_unlock (&state->Mutex);
+	int i;
+	for (i = 0; i < reader->Shards; ++i)
+		munmap ((void*) reader->Segments[i], reader->Lengths[i]);
+
+	free (reader->Entries);
+	memset (reader, 0, sizeof (NDP_Reader));
 }
 
 
@@ -434,6 +4239,18 @@ const char* NDP_ErrorString (const NDP_State* state)
 		case NDP_ERROR_GET_MTU		: return "Failed to retrieve the maximum transmission unit";
 		case NDP_ERROR_ADD_PROM		: return "Failed to add the promiscuous mode";
 		case NDP_ERROR_BIND_SOCK	: return "Failed to bind the socket to the interface";
+		case NDP_ERROR_SET_FILTER	: return "Failed to attach the beacon filter";
+		case NDP_ERROR_CREATE_RING	: return "Failed to map the receive ring";
+		case NDP_ERROR_ALLOC_BATCH	: return "Failed to allocate the receive batch";
+		case NDP_ERROR_JOIN_FANOUT	: return "Failed to create the receive shards";
+		case NDP_ERROR_ALLOC_EVENTS	: return "Failed to allocate the event ring";
+		case NDP_ERROR_OPEN_CAPTURE	: return "Failed to open the capture file";
+		case NDP_ERROR_ALLOC_TABLE	: return "Failed to allocate the neighbor table";
+		case NDP_ERROR_CREATE_LOOP	: return "Failed to create the event loop";
+		case NDP_ERROR_OPEN_PERSIST	: return "Failed to open the table file";
+		case NDP_ERROR_OPEN_EXPORT	: return "Failed to create the shared memory segment";
+		case NDP_ERROR_SET_LATENCY	: return "Failed to apply the low latency socket options";
+		case NDP_ERROR_START_THREAD	: return "Failed to start, pin or prioritize a thread";
 		default						: return "Unknown error occurred";
 	}
 }
@@ -443,7 +4260,7 @@ const char* NDP_ErrorString (const NDP_State* state)
 
 const char* NDP_AddrString (const NDP_Addr* address)
 {
-	static char result[32];
+	static __thread char result[32];
 
 	sprintf (result, "%02X:%02X:%02X:%02X:%02X:%02X",
 			address->Data[0], address->Data[1], address->Data[2],
@@ -451,3 +4268,32 @@ const char* NDP_AddrString (const NDP_Addr* address)
 
 	return result;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the monotonic time in milliseconds. </summary>
+/// <remarks> This is the clock used for neighbor timestamps. </remarks>
+
+unsigned long long NDP_Time (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the monotonic time in nanoseconds. </summary>
+/// <remarks> This is the clock of beacon send times and arrivals. </remarks>
+
+unsigned long long NDP_TimeNS (void)
+{
+	return NowNS();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Returns the next value of the generator used by the library. </summary>
+/// <remarks> The seed must not be zero. </remarks>
+
+unsigned long long NDP_Random (unsigned long long* seed)
+{
+	return NextRandom (seed);
+}
@@ -20,6 +20,22 @@
 
 #include <pthread.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Version of the library this header belongs to. </summary>
+/// <remarks> The major version changes whenever NDP_State or any other
+///           public structure changes layout, which breaks the ABI. </remarks>
+
+#define NDP_VERSION_MAJOR	2
+#define NDP_VERSION_MINOR	0
+#define NDP_VERSION_PATCH	0
+
+#define NDP_VERSION ((NDP_VERSION_MAJOR << 16) | \
+					 (NDP_VERSION_MINOR <<  8) | NDP_VERSION_PATCH)
+
 
 
 //----------------------------------------------------------------------------//
@@ -33,15 +49,112 @@
 #define NDP_IFNAME_LEN	16
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Maximum number of neighbors that can be discovered. </summary>
+/// <summary> Default number of neighbors the table is sized for. </summary>
+/// <remarks> The table grows at runtime when this is exceeded. </remarks>
 
 #define NDP_TABLE_LEN	32
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Default number of frames received per batch. </summary>
+
+#define NDP_BATCH_LEN	64
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Default timing values in milliseconds. </summary>
+
+#define NDP_BEACON_INTERVAL	3000	// Time between beacons
+#define NDP_AGE_INTERVAL	500		// Time between aging ticks
+#define NDP_TIMEOUT			10000	// Time until a silent neighbor expires
+#define NDP_PUBLISH_INTERVAL	100		// Time between table snapshots
+#define NDP_PERSIST_INTERVAL	1000	// Time between saves of the table
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Default adaptive beacon schedule. </summary>
+
+#define NDP_TRICKLE_MIN			500		// Shortest interval (ms)
+#define NDP_TRICKLE_MAX			4000	// Longest interval (ms)
+#define NDP_TRICKLE_REDUNDANCY	3		// Beacons heard which suppress ours
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Number of snapshot buffers rotated by the writer. </summary>
+
+#define NDP_SNAPSHOTS		3
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Dimensions of the timing wheel used for expiry. </summary>
+
+#define NDP_WHEEL_LEVELS	2
+#define NDP_WHEEL_BITS		8
+#define NDP_WHEEL_LEN		(1 << NDP_WHEEL_BITS)
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Number of sequence numbers covered by link statistics. </summary>
+
+#define NDP_LINK_WINDOW		64
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Maximum number of receive shards of a state. </summary>
+
+#define NDP_SHARDS_MAX		16
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Number of buckets in a latency histogram. </summary>
+
+#define NDP_HISTOGRAM_LEN	32
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Default rate of spoofed beacons per second. </summary>
+
+#define NDP_STRESS_RATE	10000
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Default time the kernel busy polls the device (us). </summary>
+
+#define NDP_BUSY_POLL	50
+
 ////////////////////////////////////////////////////////////////////////////////
 /// <summary> Maximum length of a WLAN address. </summary>
 
 #define NDP_ADDR_LEN	6
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Wire format of a beacon. </summary>
+/// <remarks> A 14 byte Ethernet header of this type is followed by a
+///           version and fields made of a type, a length and a value in
+///           network byte order. The payload ends at the end of the frame
+///           or at a field of type zero. Frames are padded to 60 bytes. </remarks>
+
+#define NDP_BEACON_TYPE			0x3900
+#define NDP_BEACON_VERSION		1
+#define NDP_BEACON_HEADER_LEN	14
+#define NDP_BEACON_MAX_LEN		60
+
+enum
+{
+	NDP_FIELD_END = 0,		// Ends the payload
+	NDP_FIELD_SEQUENCE,		// Sequence number (32 bits)
+	NDP_FIELD_TIMESTAMP,	// Send time in nanoseconds (64 bits)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Threading modes used to run the protocol. </summary>
+
+enum
+{
+	NDP_MODE_POLL = 0,		// Send and recv threads that sleep between polls
+	NDP_MODE_EVENT,			// Engine thread blocking on epoll and timers
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Backends used to receive beacons from the socket. </summary>
+
+enum
+{
+	NDP_RECV_SOCKET = 0,	// One recvfrom call per beacon
+	NDP_RECV_RING,			// Memory-mapped TPACKET_V3 ring
+	NDP_RECV_BATCH,			// Batches of frames through recvmmsg
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// <summary> Represents an NDP address type. </summary>
 
@@ -53,20 +166,263 @@ typedef struct
 } NDP_Addr;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Represents a single neighbor entry. </summary>
+/// <summary> Represents the link tracking state of a neighbor. </summary>
 
 typedef struct
 {
-	NDP_Addr Addr;	// Neighbor address
-	char Arrived;	// Has arrived
-	char Recorded;	// Last recorded
+	unsigned long long Window;	// Beacons received, bit i is Sequence - i
+	unsigned long long Arrival;	// Arrival of the latest beacon (ns)
+	unsigned long long Sent;	// Send time of the latest beacon (ns)
+	unsigned long long Interval;	// Mean time between beacons (ns)
+	unsigned long long Jitter;	// Mean deviation of the transit time (ns)
+	unsigned int Sequence;		// Latest sequence number
+	unsigned char Span;			// Sequence numbers in the window
+	char Extended;				// Beacons carry sequence numbers
+
+} NDP_Track;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single neighbor entry. </summary>
+/// <remarks> Only holds what the timing wheel needs, the state updated
+///           by every beacon lives in the table next to the keys. </remarks>
+
+typedef struct NDP_Neighbor
+{
+	NDP_Addr Addr;				// Neighbor address
+	unsigned long long Expiry;	// Tick the neighbor is filed under
+
+	struct NDP_Neighbor*  Next;	// Next neighbor in the wheel slot
+	struct NDP_Neighbor** Prev;	// Link pointing to this neighbor
 
 } NDP_Neighbor;
 
 ////////////////////////////////////////////////////////////////////////////////
-/// <summary> Represents a single state of the NDP protocol. </summary>
+/// <summary> Represents a hierarchical timing wheel of neighbors. </summary>
+/// <remarks> Each level spans NDP_WHEEL_LEN times the previous one,
+///           the first level has one slot per aging tick. </remarks>
+
+typedef struct
+{
+	NDP_Neighbor* Slots[NDP_WHEEL_LEVELS][NDP_WHEEL_LEN];
+	unsigned long long Tick;	// Last tick processed
+
+} NDP_Wheel;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the quality of the link to a neighbor. </summary>
+/// <remarks> Counts cover the last NDP_LINK_WINDOW sequence numbers, the
+///           loss rate is Lost / (Received + Lost). Legacy beacons have
+///           no sequence numbers so none of them are counted as lost. </remarks>
 
 typedef struct
+{
+	unsigned int Received;		// Beacons received in the window
+	unsigned int Lost;			// Beacons missing from the window
+	unsigned int Interval;		// Mean time between beacons (us)
+	unsigned int Jitter;		// Mean deviation of the transit time (us)
+	char Extended;				// Beacons carry sequence numbers
+
+} NDP_Link;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a neighbor in a published snapshot. </summary>
+
+typedef struct
+{
+	NDP_Addr Addr;				// Neighbor address
+	unsigned long long Seen;	// Time of the last beacon (ms)
+	NDP_Link Link;				// Quality of the link
+
+} NDP_Entry;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents an immutable copy of the neighbor table. </summary>
+/// <remarks> Obtained through NDP_AcquireSnapshot, the contents do not
+///           change until it is returned with NDP_ReleaseSnapshot. </remarks>
+
+typedef struct
+{
+	NDP_Entry* Entries;			// Neighbor entries
+	unsigned int Count;			// Number of entries
+	unsigned int Size;			// Allocated entries
+
+	unsigned long long Time;	// Time of publication (ms)
+	unsigned long long Version;	// Publication number
+	unsigned long long Layout;	// Changes when entries are added,
+								// removed or reordered
+	volatile int Readers;		// Number of active readers
+
+} NDP_Snapshot;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Kinds of neighbor events. </summary>
+
+enum
+{
+	NDP_NEIGHBOR_UP = 0,	// A new neighbor was added
+	NDP_NEIGHBOR_DOWN,		// A neighbor expired or was cleared
+	NDP_NEIGHBOR_REFRESH,	// A known neighbor sent a beacon
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a change of a single neighbor. </summary>
+
+typedef struct
+{
+	int Type;					// One of the neighbor events
+	NDP_Addr Addr;				// Neighbor address
+	unsigned long long Time;	// Time of the change (ms)
+
+} NDP_Event;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Receives neighbor events as they happen. </summary>
+/// <remarks> Called by the receiving thread while the table is locked,
+///           it must return quickly and must not call NDP_Lock. </remarks>
+
+typedef void (*NDP_EventCallback) (const NDP_Event* event, void* data);
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a merged view over the snapshots of all shards. </summary>
+
+typedef struct
+{
+	const NDP_Snapshot* Shards[NDP_SHARDS_MAX];
+	int Count;					// Number of shards
+	unsigned int Total;			// Neighbors in all shards
+
+} NDP_View;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the counters of a state. </summary>
+/// <remarks> Bucket i of a histogram counts durations of at least 2^i
+///           and below 2^(i+1) nanoseconds, the last is unbounded. </remarks>
+
+typedef struct
+{
+	unsigned long long FramesReceived;	// Frames read from the socket
+	unsigned long long FramesFiltered;	// Frames which were not beacons
+	unsigned long long BeaconsAccepted;	// Beacons applied to the table
+	unsigned long long TableDrops;		// New neighbors which did not fit
+	unsigned long long Inserts;			// Neighbors added
+	unsigned long long Expiries;		// Neighbors expired
+	unsigned long long BeaconsSent;		// Beacons broadcast
+	unsigned long long SendErrors;		// Failed sends
+	unsigned long long BeaconsSuppressed;	// Beacons held back by the schedule
+
+	// Time the table lock is held while receiving and aging
+	unsigned long long LockHold[NDP_HISTOGRAM_LEN];
+
+	// Time from frames reaching user space to being published
+	unsigned long long Latency[NDP_HISTOGRAM_LEN];
+
+	// Time from the kernel receiving beacons to the table being
+	// updated, only recorded with Timestamps
+	unsigned long long WireLatency[NDP_HISTOGRAM_LEN];
+
+} NDP_Stats;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Magic number and version of shared memory exports. </summary>
+/// <remarks> The version changes whenever NDP_Export changes layout. </remarks>
+
+#define NDP_EXPORT_MAGIC	0x5850444E	// "NDPX"
+#define NDP_EXPORT_VERSION	2
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents the shared memory segment a shard exports. </summary>
+/// <remarks> Guarded by a sequence lock: Sequence is odd while the
+///           writer updates the segment, readers copy what they need
+///           and retry if Sequence changed meanwhile. Use NDP_OpenReader
+///           instead of reading it directly. </remarks>
+
+typedef struct
+{
+	unsigned int Magic;			// Identifies the segment
+	unsigned int Version;		// Layout of the segment
+	volatile unsigned int Sequence;	// Odd while being written
+	volatile int Closed;		// Set once the writer is gone
+	int Shards;					// Segments exported by the state
+
+	char Interface[NDP_IFNAME_LEN];	// Interface name
+	int IfIndex;				// Interface index
+	int MTU;					// Maximum transmission unit
+	NDP_Addr Addr;				// Local MAC address
+	int Timeout;				// Time until a silent neighbor expires
+
+	unsigned int Size;			// Entries the segment has room for
+	unsigned int Count;			// Entries in use
+	unsigned long long Time;	// Time of publication (ms)
+	NDP_Stats Stats;			// Counters of the shard
+	NDP_Entry Entries[];		// Neighbor entries
+
+} NDP_Export;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a reader of the segments a state exports. </summary>
+/// <remarks> Filled in by NDP_ReadExport, which merges every shard. </remarks>
+
+typedef struct
+{
+	const NDP_Export* Segments[NDP_SHARDS_MAX];	// Mapped segments
+	unsigned long Lengths[NDP_SHARDS_MAX];		// Lengths of the mappings
+	int Shards;					// Number of segments
+
+	char Interface[NDP_IFNAME_LEN];	// Interface name
+	int IfIndex;				// Interface index
+	int MTU;					// Maximum transmission unit
+	NDP_Addr Addr;				// Local MAC address
+	int Timeout;				// Time until a silent neighbor expires
+
+	unsigned long long Time;	// Latest publication (ms)
+	NDP_Stats Stats;			// Counters of every shard
+
+	NDP_Entry* Entries;			// Neighbors of every shard
+	unsigned int Count;			// Number of entries
+	unsigned int Size;			// Allocated entries
+	unsigned long long Retries;	// Copies repeated due to the writer
+
+} NDP_Reader;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a pool of preallocated neighbor entries. </summary>
+/// <remarks> Entries are carved out of slabs and recycled through a
+///           free list, slabs are only released by NDP_Destroy. </remarks>
+
+typedef struct
+{
+	void* Slabs;			// List of allocated slabs
+	void* Free;				// List of released entries
+	unsigned int Size;		// Total number of entries
+
+} NDP_Pool;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents an open addressing hash table of neighbors. </summary>
+/// <remarks> Empty slots are NULL, capacity is a power of two. Lookups
+///           only compare the packed keys kept alongside the slots, and
+///           refreshes only touch the arrays parallel to them. </remarks>
+
+typedef struct
+{
+	unsigned long long* Keys;	// Packed addresses (0 = empty)
+	unsigned long long* Seen;	// Time of the last beacon (ms)
+	unsigned long long* Expiry;	// Tick the neighbor expires on
+	NDP_Track* Tracks;		// Link tracking state
+	NDP_Neighbor** Slots;	// Table slots
+	unsigned int Capacity;	// Number of slots
+	unsigned int Count;		// Number of neighbors
+	NDP_Pool Pool;			// Neighbor storage
+	NDP_Wheel Wheel;		// Neighbor expiry
+	char Dirty;				// Changed since the last snapshot
+	unsigned long long Layout;	// Bumped when neighbors move slots
+
+} NDP_Table;
+
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents a single state of the NDP protocol. </summary>
+
+typedef struct NDP_State
 {
 	int Error;				// Index of the error
 
@@ -77,22 +433,202 @@ typedef struct
 
 	volatile char Active;	// Currently active
 	volatile char Stress;	// Stress test mode
+		// Use NDP_SetStress to change this value
 
 	pthread_t SendThread;	// Send thread ID
 	pthread_t RecvThread;	// Recv thread ID
 	pthread_mutex_t Mutex;	// Synchronization
 
+	void* Ring;				// Mapped receive ring
+	unsigned int RingBlock;	// Next ring block to read
+
+	void* Batch;			// Receive batch buffers
+	volatile unsigned long long Batches;		// Batches received
+	volatile unsigned long long BatchFrames;	// Frames in all batches
+		// Average fill of a batch is BatchFrames / Batches
+
+	void* Events;			// Ring of neighbor events
+	void* Capture;			// Pcap file of accepted beacons
+	char* CaptureQueue;		// Records awaiting the file
+	unsigned int CaptureLen;	// Bytes of queued records
+	unsigned int CaptureSize;	// Allocated bytes of the queue
+	void* Persist;			// Mapped file of the table
+	void* Export;			// Shared memory segment
+	unsigned long long PersistTime;	// Time of the latest save (ms)
+
+	struct NDP_State* Workers;	// Additional receive shards
+	int WorkerCount;		// Number of workers
+	struct NDP_State* Parent;	// State owning a worker
+
+	void* Flood;			// Stress testing senders
+	int FloodCount;			// Number of senders
+	unsigned long long StressSent;	// Beacons sent by stopped senders
+	unsigned long long StressErrors;	// Failed sends of stopped senders
+
+	// Counters written only by the receiving and the sending
+	// thread, kept apart so they never share a cache line
+	NDP_Stats RecvStats __attribute__ ((aligned (64)));
+	NDP_Stats SendStats __attribute__ ((aligned (64)));
+		// Use NDP_GetStats to read them
+
+	unsigned int Sequence;	// Sequence number of the next beacon
+
+	unsigned long long NextBeacon;	// Next beacon of NDP_Process
+	unsigned long long NextAge;		// Next aging of NDP_Process
+
+	unsigned long long TrickleStart;	// Start of the current interval
+	unsigned long long TrickleFire;		// Time to decide on a beacon
+	unsigned long long TrickleSent;		// Time of the latest beacon
+	unsigned long long TrickleSeed;		// Random state of the schedule
+	unsigned int TrickleInterval;		// Current interval (0 = restart)
+	char TrickleDone;					// Decided in the current interval
+	volatile unsigned int TrickleHeard;	// Known neighbors heard since
+	volatile char TrickleReset;			// Neighborhood has changed
+
+	struct NDP_Engine* Engine;	// Engine running the state
+	int SendTimer;			// Beacon timer descriptor
+	int AgeTimer;			// Aging timer descriptor
+
 	// Represents an interface to use
 	char Interface[NDP_IFNAME_LEN];
 		// Must be set before calling NDP_Create
 
+	// Represents whether to enable promiscuous mode
+	char Promisc;
+		// Beacons are broadcast so this is rarely needed
+		// Must be set before calling NDP_Create
+
+	// Represents the receive backend
+	int Backend;
+	int BatchSize;			// Frames per batch (NDP_RECV_BATCH)
+		// Must be set before calling NDP_Create
+
+	// Represents the number of receive shards
+	int Shards;
+		// Above one, extra sockets join a fanout group which
+		// hashes on the source address, each feeding its own
+		// worker and table. Use NDP_AcquireView to read them.
+		// Must be set before calling NDP_Create
+
+	// Represents whether to only listen for beacons
+	char Silent;
+		// Must be set before calling NDP_Start
+
+	// Represents the delivery of neighbor events
+	int EventSize;			// Ring length (0 = disabled)
+	NDP_EventCallback EventCallback;	// Called instead of the ring
+	void* EventData;		// Passed to the callback
+		// Drain the ring with NDP_PollEvents, a callback may be
+		// called from several threads when using shards
+		// Must be set before calling NDP_Create
+
+	// Represents the file accepted beacons are written to
+	const char* CapturePath;
+		// Beacons are written in pcap format, NULL disables it
+		// Must be set before calling NDP_Create
+
+	// Represents the file the table is kept in across restarts
+	const char* PersistPath;
+	int PersistInterval;	// Time between saves (ms)
+		// NDP_Create reloads the neighbors saved by a previous run,
+		// aged by the time since they were last seen, so the table
+		// is usable at once. Shards keep their own file with the
+		// shard index appended to the path. NULL disables it.
+		// Must be set before calling NDP_Create
+
+	// Represents the shared memory segment the table is exported to
+	const char* ExportName;
+		// Name given to shm_open, such as "/metropolis". Every
+		// published snapshot is copied there with the counters
+		// and interface, shards export to the name followed by
+		// their index. Read it with NDP_OpenReader. NULL disables
+		// it. Must be set before calling NDP_Create
+
+	// Represents the table configuration
+	int TableSize;			// Expected number of neighbors
+	int TableLimit;			// Maximum neighbors (0 = unlimited)
+		// Must be set before calling NDP_Create
+
+	// Represents the threading mode
+	int Mode;
+		// Must be set before calling NDP_Start
+
+	// Represents the low latency profile
+	char LowLatency;		// Poll the socket instead of sleeping
+	int BusyPoll;			// Time the kernel polls the device (us)
+	int SendCPU;			// CPU of the send thread (-1 = any)
+	int RecvCPU;			// CPU of the receive thread (-1 = any)
+	int Priority;			// SCHED_FIFO priority (0 = none)
+		// With LowLatency the receiving thread polls its socket
+		// in a loop and occupies a whole CPU, and beacons bypass
+		// the queueing discipline. The CPUs and priority apply
+		// on their own too. The engine thread takes the receive
+		// CPU of its first state and shards run on the CPUs
+		// following it. Must be set before calling NDP_Create
+
+	// Represents whether to record kernel receive timestamps
+	char Timestamps;
+		// Fills the WireLatency histogram of the statistics
+		// Must be set before calling NDP_Create
+
+	// Represents the timing configuration (ms)
+	int BeaconInterval;		// Time between beacons
+	int AgeInterval;		// Time between aging ticks
+	int Timeout;			// Time until a silent neighbor expires
+	int PublishInterval;	// Time between table snapshots
+		// Must be set before calling NDP_Create
+
+	// Represents the adaptive beacon schedule (ms)
+	char Adaptive;			// Use instead of BeaconInterval
+	int TrickleMin;			// Interval after the neighborhood changes
+	int TrickleMax;			// Interval reached while it is stable
+	int TrickleRedundancy;	// Beacons heard which suppress ours
+		// The interval doubles up to the maximum while the same
+		// neighbors are heard and drops to the minimum when one
+		// arrives or expires. A beacon is sent at a random point
+		// in the second half of each interval unless enough were
+		// heard from known neighbors, but never later than half
+		// the timeout after the previous one.
+		// Must be set before calling NDP_Create
+
+	// Represents the stress testing configuration
+	int StressRate;			// Beacons per second (0 = unlimited)
+	int StressThreads;		// Number of sender threads
+		// Must be set before calling NDP_SetStress
+
 	// Represents a table of neighbors
-	NDP_Neighbor* Table[NDP_TABLE_LEN];
+	NDP_Table Table;
 		// A call to NDP_Lock must be made before accessing
 		// this variable. When finished, call NDP_Unlock.
 
+	// Represents published copies of the table
+	NDP_Snapshot Snapshots[NDP_SNAPSHOTS];
+	volatile int Published;				// Index of the latest copy
+	unsigned long long PublishTime;		// Time of the latest copy (ms)
+		// Use NDP_AcquireSnapshot to read without locking
+
 } NDP_State;
 
+////////////////////////////////////////////////////////////////////////////////
+/// <summary> Represents an event loop shared by several states. </summary>
+/// <remarks> Each state keeps its own socket, timers and table while a
+///           single thread handles all of their I/O through epoll. </remarks>
+
+typedef struct NDP_Engine
+{
+	int Error;				// Index of the error
+
+	NDP_State** States;		// States run by the engine
+	int Count;				// Number of states
+	NDP_State* Owner;		// State owning a private engine
+
+	int EpollID;			// Event loop descriptor
+	int StopEvent;			// Shutdown event descriptor
+	pthread_t Thread;		// Loop thread ID
+	volatile char Active;	// Currently active
+
+} NDP_Engine;
+
 
 
 //----------------------------------------------------------------------------//
@@ -108,6 +644,18 @@ enum
 	NDP_ERROR_GET_MTU,
 	NDP_ERROR_ADD_PROM,
 	NDP_ERROR_BIND_SOCK,
+	NDP_ERROR_SET_FILTER,
+	NDP_ERROR_CREATE_RING,
+	NDP_ERROR_ALLOC_BATCH,
+	NDP_ERROR_JOIN_FANOUT,
+	NDP_ERROR_ALLOC_TABLE,
+	NDP_ERROR_ALLOC_EVENTS,
+	NDP_ERROR_OPEN_CAPTURE,
+	NDP_ERROR_CREATE_LOOP,
+	NDP_ERROR_OPEN_PERSIST,
+	NDP_ERROR_OPEN_EXPORT,
+	NDP_ERROR_SET_LATENCY,
+	NDP_ERROR_START_THREAD,
 };
 
 
@@ -117,6 +665,7 @@ enum
 //----------------------------------------------------------------------------//
 
 // Core
+void NDP_Init    (NDP_State* state);
 void NDP_Create  (NDP_State* state);
 void NDP_Destroy (NDP_State* state);
 
@@ -126,8 +675,54 @@ void NDP_Stop    (NDP_State* state);
 void NDP_Lock    (NDP_State* state);
 void NDP_Unlock  (NDP_State* state);
 
+// Loop
+int NDP_Process  (NDP_State* state);
+unsigned int NDP_Version (void);
+
+// Offline
+void NDP_CreateOffline (NDP_State* state, unsigned long long now);
+void NDP_Inject  (NDP_State* state, const NDP_Addr* source, unsigned long long now);
+void NDP_Advance (NDP_State* state, unsigned long long now);
+long long NDP_Replay (NDP_State* state, const char* path, int paced);
+
+// Engine
+void NDP_EngineStart (NDP_Engine* engine, NDP_State** states, int count);
+void NDP_EngineStop  (NDP_Engine* engine);
+
+// Snapshots
+const NDP_Snapshot* NDP_AcquireSnapshot (NDP_State* state);
+void NDP_ReleaseSnapshot (const NDP_Snapshot* snapshot);
+
+void NDP_AcquireView (NDP_State* state, NDP_View* view);
+void NDP_ReleaseView (NDP_View* view);
+
+// Statistics
+void NDP_GetStats (NDP_State* state, NDP_Stats* stats);
+void NDP_AddStats (NDP_Stats* total, const NDP_Stats* stats);
+unsigned long long NDP_Percentile (const unsigned long long* histogram, double p);
+
+// Events
+int NDP_PollEvents (NDP_State* state, NDP_Event* events, int count);
+unsigned long long NDP_EventDrops (const NDP_State* state);
+
+// Export
+int  NDP_OpenReader  (NDP_Reader* reader, const char* name);
+int  NDP_ReadExport  (NDP_Reader* reader);
+void NDP_CloseReader (NDP_Reader* reader);
+
+// Stress
+void NDP_SetStress (NDP_State* state, int enable);
+unsigned long long NDP_StressSent (const NDP_State* state);
+
 // Helpers
 const char* NDP_ErrorString (const NDP_State* state  );
 const char* NDP_AddrString  (const NDP_Addr*  address);
+unsigned long long NDP_Time   (void);
+unsigned long long NDP_TimeNS (void);
+unsigned long long NDP_Random (unsigned long long* seed);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // NDP_PROTOCOL_H